@@ -14,6 +14,21 @@ local debug = (function()
     return true
 end)()
 
+local function has_arg(name)
+    for _, x in ipairs(arg) do
+        if x == name then
+            return true
+        end
+    end
+    return false
+end
+
+-- build with libdeflate (lib/libdeflate.lib) for whole-entry decompression
+local libdeflate = has_arg('--libdeflate')
+
+-- build with zstd (lib/zstd.lib) to read Zstandard entries
+local zstd = has_arg('--zstd')
+
 ninja.build_dir(debug and 'debug' or 'release')
 
 local ATL_DIR = 'c:/apps/msvc/atlmfc/'
@@ -38,6 +53,14 @@ local cc = ninja.target('cc')
     :lib_dir(public { 'lib' })
     :lib(public { 'mimalloc.lib', 'advapi32.lib', 'user32.lib', 'shell32.lib', 'zlib.lib' })
 
+if libdeflate then
+    cc:define(public { 'ZIP_WITH_LIBDEFLATE' }):lib(public { 'libdeflate.lib' })
+end
+
+if zstd then
+    cc:define(public { 'ZIP_WITH_ZSTD' }):lib(public { 'zstd.lib' })
+end
+
 local zipfs = ninja.target('zipfs')
     :type('binary')
     :deps(cc)
@@ -46,6 +69,18 @@ local zipfs = ninja.target('zipfs')
     :include_dir('dokan/include/dokan'):lib_dir('dokan/lib'):lib('dokan2.lib')
     :src('zipfs.cpp')
 
+-- replays cache traces recorded with zipfs --cache_trace against the eviction policies
+local cachesim = ninja.target('cachesim')
+    :type('binary')
+    :deps(cc)
+    :src('cachesim.cpp')
+
+-- decompresses an archive with each decoder built in and reports MB/s and files/s
+local zipbench = ninja.target('zipbench')
+    :type('binary')
+    :deps(cc)
+    :src('zipbench.cpp')
+
 ninja.build()
 
 -- ninja.watch(
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Eviction policy of an entry_cache
+enum class cache_policy {
+    // Least recently used
+    LRU,
+
+    // 2Q: new items wait in a fifo, only those requested again after leaving it (their keys are remembered
+    // for a while) reach the main lru, so a single pass over many items never displaces it
+    TWO_Q,
+
+    // W-TinyLFU: new items pass a small lru window, then enter the main segment only if a frequency sketch
+    // says they are requested more often than the item they would displace
+    TINY_LFU
+};
+
+// Approximate access counts of hashed keys, a count-min sketch of 4-bit counters. Counters are halved once
+// increments reach ten times the number of items the sketch is sized for, so past popularity fades.
+class frequency_sketch {
+public:
+    // Size the sketch for about n distinct items, growing it forgets the counts
+    void reserve(size_t n) {
+        size_t words = 64; while(words < n) words <<= 1;
+
+        if(words > m_table.size()) {
+            m_table.assign(words, 0); m_sample = words * 10; m_additions = 0;
+        }
+    }
+
+    void increment(uint64_t hash) {
+        if(m_table.empty()) reserve(0);
+
+        bool added = false; for(int i = 0; i < 4; ++i) {
+            auto [word, shift] = counter(hash, i); if(((m_table[word] >> shift) & 15) != 15) {
+                m_table[word] += uint64_t(1) << shift; added = true;
+            }
+        }
+
+        if(added && ++m_additions >= m_sample) age();
+    }
+
+    unsigned frequency(uint64_t hash) const {
+        if(m_table.empty()) return 0;
+
+        unsigned f = 15; for(int i = 0; i < 4; ++i) {
+            auto [word, shift] = counter(hash, i); f = std::min(f, unsigned(m_table[word] >> shift) & 15);
+        }
+
+        return f;
+    }
+
+private:
+    // Word and bit offset of the counter of a hash in row i
+    std::pair<size_t, unsigned> counter(uint64_t hash, int i) const {
+        uint64_t x = hash + uint64_t(i + 1) * 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull; x = (x ^ (x >> 27)) * 0x94D049BB133111EBull; x ^= x >> 31;
+
+        return {static_cast<size_t>(x) & (m_table.size() - 1), unsigned(x >> 60) * 4};
+    }
+
+    void age() {
+        for(auto & w : m_table) w = (w >> 1) & 0x7777777777777777ull;
+
+        m_additions /= 2;
+    }
+
+    std::vector<uint64_t> m_table; size_t m_sample {0}; size_t m_additions {0};
+};
+
+// A cache which evicts items per its policy when their cost exceeds its capacity.
+//
+// Items live in a pool which never moves them and are found through an open addressing table of pool
+// indexes. The policy's queues are intrusive lists through the items, a hit only relinks the item.
+template<class Key, class Value, class Hash = std::hash<Key>>
+class entry_cache {
+public:
+    typedef Key key_type;
+    typedef Value value_type;
+
+    entry_cache(size_t capacity, cache_policy policy = cache_policy::LRU) : m_capacity(capacity), m_policy(policy) {}
+
+    size_t size() const { return m_size; }
+
+    size_t capacity() const { return m_capacity; }
+
+    cache_policy policy() const { return m_policy; }
+
+    // Total cost of the cached items
+    size_t used() const { return m_used; }
+
+    bool empty() const { return m_size == 0; }
+
+    bool contains(const key_type & key) const { return peek(key) != nullptr; }
+
+    // Called with the key and cost of every evicted item
+    std::function<void(const key_type &, size_t)> on_evict;
+
+    // Insert an item and return it, an item already cached is returned as is. The inserted item stays at
+    // least until the next insert, even when it costs more than the capacity.
+    template<typename K, typename V>
+    value_type * insert(K && key, V && value, size_t cost = 1) {
+        uint32_t n = m_slots.size() ? m_slots[find(key)] : NIL; if(n != NIL && m_nodes[n].queue != GHOST) {
+            return &m_nodes[n].value;
+        }
+
+        int queue = RECENT; if(n != NIL) {
+            // a key remembered by 2Q was requested again soon after leaving the fifo, it goes to the main lru
+            unlink(n); --m_ghosts; queue = FREQUENT;
+        }
+        else {
+            // take a freed node, the pool only grows when all are in use
+            n = m_free; if(n != NIL) {
+                m_free = m_nodes[n].next;
+            }
+            else {
+                n = static_cast<uint32_t>(m_nodes.size()); m_nodes.emplace_back();
+            }
+
+            m_nodes[n].key = std::forward<K>(key);
+
+            // keep the table at most half full so probe runs stay short
+            if((m_size + m_ghosts + 1) * 2 > m_slots.size()) {
+                rehash(std::max<size_t>(16, m_slots.size() * 2));
+            }
+
+            m_slots[find(m_nodes[n].key)] = n;
+        }
+
+        auto & node = m_nodes[n]; node.value = std::forward<V>(value); node.cost = cost;
+
+        push(queue, n); m_used += cost; ++m_size; if(m_policy == cache_policy::TINY_LFU) {
+            m_sketch.reserve(m_size);
+        }
+
+        make_room(n);
+
+        return &node.value;
+    }
+
+    // Lookup an item and record the access
+    value_type * get(const key_type & key) {
+        if(m_policy == cache_policy::TINY_LFU) {
+            m_sketch.increment(hash(key));
+        }
+
+        if(m_slots.empty()) return nullptr;
+
+        uint32_t n = m_slots[find(key)]; if(n == NIL || m_nodes[n].queue == GHOST) return nullptr;
+
+        switch(m_nodes[n].queue) {
+            case RECENT: {
+                // the 2Q fifo keeps its order, hits there do not prove an item is hot
+                if(m_policy != cache_policy::TWO_Q && n != m_heads[RECENT]) {
+                    unlink(n); push(RECENT, n);
+                }
+            } break;
+
+            case FREQUENT: {
+                if(n != m_heads[FREQUENT]) {
+                    unlink(n); push(FREQUENT, n);
+                }
+            } break;
+
+            case PROBATION: {
+                // a second hit in the main segment protects an item, the protected segment's least recently
+                // used items go back on probation beyond its share
+                unlink(n); push(FREQUENT, n);
+
+                while(m_cost[FREQUENT] > protected_capacity() && m_tails[FREQUENT] != n) {
+                    auto t = m_tails[FREQUENT]; unlink(t); push(PROBATION, t);
+                }
+            } break;
+        }
+
+        return &m_nodes[n].value;
+    }
+
+    // Lookup an item without recording the access
+    value_type * peek(const key_type & key) {
+        return const_cast<value_type *>(static_cast<const entry_cache *>(this)->peek(key));
+    }
+
+    const value_type * peek(const key_type & key) const {
+        if(m_slots.empty()) return nullptr;
+
+        uint32_t n = m_slots[find(key)]; return n == NIL || m_nodes[n].queue == GHOST ? nullptr : &m_nodes[n].value;
+    }
+
+    // Change the cost of a cached item without recording an access, false when it is not cached. Like an
+    // inserted item it stays at least until the next insert.
+    bool recharge(const key_type & key, size_t cost) {
+        if(m_slots.empty()) return false;
+
+        uint32_t n = m_slots[find(key)]; if(n == NIL || m_nodes[n].queue == GHOST) return false;
+
+        auto & node = m_nodes[n]; m_cost[node.queue] = m_cost[node.queue] - node.cost + cost; m_used = m_used - node.cost + cost; node.cost = cost;
+
+        make_room(n);
+
+        return true;
+    }
+
+    void clear() {
+        m_nodes.clear(); m_slots.clear(); m_free = NIL; m_size = m_ghosts = m_used = 0;
+
+        std::fill(std::begin(m_heads), std::end(m_heads), NIL); std::fill(std::begin(m_tails), std::end(m_tails), NIL);
+        std::fill(std::begin(m_cost), std::end(m_cost), 0);
+    }
+
+    // Evict the first item in eviction order whose key satisfies pred, false when there is none
+    template<typename P>
+    bool evict_if(P && pred) {
+        for(int queue : eviction_order()) {
+            if(queue < 0) break;
+
+            for(uint32_t n = m_tails[queue]; n != NIL; n = m_nodes[n].prev) {
+                if(pred(m_nodes[n].key)) { evict(n); return true; }
+            }
+        }
+
+        return false;
+    }
+
+    // Drop the items whose keys satisfy pred without reporting them as evicted
+    template<typename P>
+    void erase_if(P && pred) {
+        for(int queue = 0; queue < QUEUES; ++queue) {
+            for(uint32_t n = m_tails[queue]; n != NIL;) {
+                uint32_t prev = m_nodes[n].prev; if(pred(m_nodes[n].key)) remove(n);
+
+                n = prev;
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    // LRU keeps everything in RECENT. 2Q has its fifo in RECENT, its main lru in FREQUENT and the keys of
+    // items evicted from the fifo in GHOST. W-TinyLFU has its window in RECENT, its main segment in
+    // PROBATION and FREQUENT (protected).
+    enum { RECENT, FREQUENT, PROBATION, GHOST, QUEUES };
+
+    struct node_type { key_type key {}; value_type value {}; size_t cost {0}; uint32_t prev {NIL}; uint32_t next {NIL}; int queue {RECENT}; };
+
+    // share of the 2Q fifo and of the W-TinyLFU window and protected segment
+    size_t fifo_capacity() const { return m_capacity / 4; }
+
+    size_t window_capacity() const { return m_capacity / 100; }
+
+    size_t protected_capacity() const { return (m_capacity - window_capacity()) / 5 * 4; }
+
+    // queues in the order they give up items, -1 terminated
+    std::array<int, 4> eviction_order() const {
+        switch(m_policy) {
+            case cache_policy::TWO_Q: {
+                if(m_cost[RECENT] > fifo_capacity() || m_heads[FREQUENT] == NIL) return {RECENT, FREQUENT, -1, -1};
+
+                return {FREQUENT, RECENT, -1, -1};
+            }
+            case cache_policy::TINY_LFU: return {PROBATION, FREQUENT, RECENT, -1};
+            default: return {RECENT, -1, -1, -1};
+        }
+    }
+
+    void make_room(uint32_t n) {
+        // the window's overflow asks for admission to the main segment, the newest item waits for the next insert
+        if(m_policy == cache_policy::TINY_LFU) {
+            while(m_cost[RECENT] > window_capacity() && m_tails[RECENT] != n) {
+                admit(m_tails[RECENT], n);
+            }
+        }
+
+        // evict in policy order, never the item just inserted or recharged
+        while(m_used > m_capacity) {
+            uint32_t victim = NIL; for(int queue : eviction_order()) {
+                if(queue < 0) break;
+
+                victim = m_tails[queue]; if(victim == n) victim = m_nodes[n].prev;
+
+                if(victim != NIL) break;
+            }
+
+            if(victim == NIL) break;
+
+            evict(victim);
+        }
+    }
+
+    // W-TinyLFU admission of a candidate leaving the window: it displaces main segment items as long as it
+    // is requested more often than each, otherwise it is evicted. The item kept by make_room is never displaced.
+    void admit(uint32_t c, uint32_t keep) {
+        for(size_t room = m_capacity - window_capacity(); m_cost[PROBATION] + m_cost[FREQUENT] + m_nodes[c].cost > room;) {
+            uint32_t victim = NIL; for(int queue : {PROBATION, FREQUENT}) {
+                victim = m_tails[queue]; if(victim == keep) victim = m_nodes[keep].prev;
+
+                if(victim != NIL) break;
+            }
+
+            if(victim == NIL) break;
+
+            if(m_sketch.frequency(hash(m_nodes[c].key)) <= m_sketch.frequency(hash(m_nodes[victim].key))) {
+                evict(c); return;
+            }
+
+            evict(victim);
+        }
+
+        unlink(c); push(PROBATION, c);
+    }
+
+    uint64_t hash(const key_type & key) const { return uint64_t(Hash {}(key)) * 0x9E3779B97F4A7C15ull; }
+
+    // home slot of a key, taken from the top bits of the mixed hash so that runs of adjacent keys spread
+    size_t home(const key_type & key) const { return static_cast<size_t>(hash(key) >> m_shift); }
+
+    // slot holding the key, or the empty slot ending its probe run
+    size_t find(const key_type & key) const {
+        size_t mask = m_slots.size() - 1, i = home(key); while(m_slots[i] != NIL && !(m_nodes[m_slots[i]].key == key)) {
+            i = (i + 1) & mask;
+        }
+
+        return i;
+    }
+
+    void rehash(size_t slots) {
+        m_slots.assign(slots, NIL); m_shift = 64; for(size_t n = slots; n > 1; n >>= 1) --m_shift;
+
+        for(int queue = 0; queue < QUEUES; ++queue) {
+            for(uint32_t n = m_heads[queue]; n != NIL; n = m_nodes[n].next) m_slots[find(m_nodes[n].key)] = n;
+        }
+    }
+
+    void push(int queue, uint32_t n) {
+        auto & node = m_nodes[n]; node.queue = queue; node.prev = NIL; node.next = m_heads[queue]; if(m_heads[queue] != NIL) {
+            m_nodes[m_heads[queue]].prev = n;
+        }
+        else {
+            m_tails[queue] = n;
+        }
+
+        m_heads[queue] = n; m_cost[queue] += node.cost;
+    }
+
+    void unlink(uint32_t n) {
+        auto & node = m_nodes[n];
+
+        (node.prev != NIL ? m_nodes[node.prev].next : m_heads[node.queue]) = node.next;
+        (node.next != NIL ? m_nodes[node.next].prev : m_tails[node.queue]) = node.prev;
+
+        m_cost[node.queue] -= node.cost;
+    }
+
+    void evict(uint32_t n) {
+        key_type key = m_nodes[n].key; size_t cost = m_nodes[n].cost; if(m_policy == cache_policy::TWO_Q && m_nodes[n].queue == RECENT) {
+            // 2Q remembers the keys of items leaving the fifo, up to half the capacity worth of them and no
+            // more keys than there are items
+            auto & node = m_nodes[n]; unlink(n); node.value = value_type {}; m_used -= cost; --m_size;
+
+            push(GHOST, n); ++m_ghosts; while(m_tails[GHOST] != NIL && (m_cost[GHOST] > m_capacity / 2 || m_ghosts > std::max<size_t>(m_size, 64))) {
+                remove(m_tails[GHOST]);
+            }
+        }
+        else {
+            remove(n);
+        }
+
+        if(on_evict) {
+            on_evict(key, cost);
+        }
+    }
+
+    void remove(uint32_t n) {
+        // backward shift deletion, later items of the probe run move up unless that would pass their home slot
+        size_t mask = m_slots.size() - 1, i = find(m_nodes[n].key); for(size_t j = (i + 1) & mask; m_slots[j] != NIL; j = (j + 1) & mask) {
+            if(((j - home(m_nodes[m_slots[j]].key)) & mask) >= ((j - i) & mask)) {
+                m_slots[i] = m_slots[j]; i = j;
+            }
+        }
+
+        m_slots[i] = NIL;
+
+        // release the value and put the node on the free list
+        auto & node = m_nodes[n]; unlink(n); if(node.queue == GHOST) {
+            --m_ghosts;
+        }
+        else {
+            m_used -= node.cost; --m_size;
+        }
+
+        node.value = value_type {}; node.cost = 0; node.queue = RECENT; node.prev = NIL; node.next = m_free; m_free = n;
+    }
+
+private:
+    std::deque<node_type> m_nodes; std::vector<uint32_t> m_slots; unsigned m_shift {64};
+    uint32_t m_heads[QUEUES] {NIL, NIL, NIL, NIL}; uint32_t m_tails[QUEUES] {NIL, NIL, NIL, NIL}; size_t m_cost[QUEUES] {};
+    uint32_t m_free {NIL}; size_t m_size {0}; size_t m_ghosts {0}; size_t m_capacity; size_t m_used {0};
+    cache_policy m_policy; frequency_sketch m_sketch;
+};
@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <cstdint>
+#include <optional>
+#include <print>
+#include <string>
+#include <vector>
+
+#include "structopt.hpp"
+#include "cache.h"
+
+using namespace std;
+
+// replays cache traces recorded by zipfs --cache_trace against each eviction policy and budget
+
+struct cachesim_options {
+    // trace file, one "<archive> <entry> <block> <cost>" line per access, block -1 for whole entries
+    string trace;
+
+    // budgets to simulate, in MB
+    optional<vector<size_t>> cache_size;
+};
+
+STRUCTOPT(cachesim_options, trace, cache_size);
+
+struct trace_key {
+    uint32_t archive; int entry; int block;
+
+    bool operator==(trace_key const & other) const { return archive == other.archive && entry == other.entry && block == other.block; }
+
+    struct hash {
+        size_t operator()(trace_key const & k) const { return size_t(((uint64_t(k.archive) << 32) | uint32_t(k.entry)) ^ (uint64_t(uint32_t(k.block)) * 0xC2B2AE3D27D4EB4Full)); }
+    };
+};
+
+struct access_t { trace_key key; size_t cost; };
+
+struct result_t { size_t hits {0}; uint64_t hit_bytes {0}; };
+
+static result_t replay(vector<access_t> const & trace, size_t capacity, cache_policy policy) {
+    struct none {}; entry_cache<trace_key, none, trace_key::hash> cache {capacity, policy}; result_t r;
+
+    for(auto & a : trace) {
+        if(cache.get(a.key)) {
+            ++r.hits; r.hit_bytes += a.cost;
+        }
+        else {
+            cache.insert(a.key, none {}, a.cost);
+        }
+    }
+
+    return r;
+}
+
+int main(int argc, char ** argv) {
+    try {
+        auto options = structopt::app("cachesim", "0.1.0").parse<cachesim_options>(argc, argv);
+
+        FILE * f = fopen(options.trace.c_str(), "r"); if(!f) {
+            println("can't open {}", options.trace); return 1;
+        }
+
+        vector<access_t> trace; uint64_t bytes = 0; {
+            unsigned archive; int entry, block; size_t cost; while(fscanf(f, "%u %d %d %zu", &archive, &entry, &block, &cost) == 4) {
+                trace.push_back({{archive, entry, block}, cost}); bytes += cost;
+            }
+
+            fclose(f);
+        }
+
+        auto sizes = options.cache_size.value_or(vector<size_t> {64, 256, 1024});
+
+        println("{} accesses, {} MB", trace.size(), bytes >> 20);
+        println("{:>10} {:>8} {:>8} {:>10}", "policy", "MB", "hits %", "bytes %");
+
+        for(auto size : sizes) {
+            for(auto [name, policy] : {pair {"lru", cache_policy::LRU}, pair {"2q", cache_policy::TWO_Q}, pair {"tinylfu", cache_policy::TINY_LFU}}) {
+                auto r = replay(trace, size << 20, policy);
+
+                println("{:>10} {:>8} {:>8.2f} {:>10.2f}", name, size,
+                    trace.empty() ? 0.0 : 100.0 * r.hits / trace.size(), bytes ? 100.0 * r.hit_bytes / bytes : 0.0);
+            }
+        }
+    }
+    catch(structopt::exception & e) {
+        println("{}", e.what()); println("{}", e.help());
+    }
+
+    return 0;
+}
@@ -7,12 +7,15 @@
 
 #include <type_traits>
 #include <algorithm>
+#include <functional>
 #include <list>
 #include <map>
 #include <optional>
 #include <string>
+#include <vector>
 #include <filesystem>
 #include <chrono>
+#include <deque>
 #include <format>
 #include <print>
 
@@ -24,3 +27,4 @@
 #include "atlfile.h"
 #include "atlconv.h"
 #include "zip.h"
+#include "cache.h"
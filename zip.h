@@ -6,15 +6,53 @@
 #include <cstring>
 #include <cstdlib>
 #include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 #include <type_traits>
 #include <utility>
 
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#    define ZIP_X86 1
+#    include <immintrin.h>
+#    if defined(_MSC_VER)
+#        include <intrin.h>
+#    else
+#        include <cpuid.h>
+#    endif
+#endif
+
+#if defined(_M_ARM64) || defined(__ARM_FEATURE_CRC32)
+#    define ZIP_ARM_CRC 1
+#    if defined(_MSC_VER) && !defined(__clang__)
+#        include <intrin.h>
+#    else
+#        include <arm_acle.h>
+#    endif
+#endif
+
+#if defined(__clang__) || defined(__GNUC__)
+#    define ZIP_TARGET(x) __attribute__((target(x)))
+#else
+#    define ZIP_TARGET(x)
+#endif
+
 #include "zlib.h"
 
+// libdeflate decodes whole entries faster than zlib, build with ZIP_WITH_LIBDEFLATE to use it
+#ifdef ZIP_WITH_LIBDEFLATE
+#    include "libdeflate.h"
+#endif
+
+// Zstandard entries (method 93) are decoded when built with ZIP_WITH_ZSTD
+#ifdef ZIP_WITH_ZSTD
+#    include "zstd.h"
+#endif
+
 // ZIP file format constants
 struct zip_constants {
     static constexpr uint16_t SIGNATURE_LOCAL_FILE = 0x0403;         // PK\x03\x04
@@ -25,6 +63,8 @@ struct zip_constants {
     // ZIP sigatures
     static constexpr uint32_t SIGNATURE_ZIP = 0x04034b50;
     static constexpr uint32_t SIGNATURE_ZIP_END_OF_CENTRAL_DIR = 0x02014b50;
+    static constexpr uint32_t SIGNATURE_ZIP_CENTRAL_DIR_ENTRY = 0x02014b50;  // PK\x01\x02
+    static constexpr uint32_t SIGNATURE_ZIP_END_OF_CENTRAL_DIR_RECORD = 0x06054b50; // PK\x05\x06
 
     // ZIP64 signatures
     static constexpr uint32_t SIGNATURE_ZIP64_END_OF_CENTRAL_DIR = 0x06064b50;         // PK\x06\x06
@@ -57,333 +97,2436 @@ enum class zip_compression_method : uint16_t {
     AEX_ENCRYPTION_MARKER = 99
 };
 
-// General purpose bit flags
-struct zip_gp_flags {
-    uint16_t raw_flags;
+// CPU features detected at runtime
+struct zip_cpu {
+    bool avx2 {false};
 
-    bool is_encrypted() const { return (raw_flags & 0x0001) != 0; }
-    bool has_data_descriptor() const { return (raw_flags & 0x0008) != 0; }
-    bool is_compressed_patched() const { return (raw_flags & 0x0020) != 0; }
-    bool is_strongly_encrypted() const { return (raw_flags & 0x0040) != 0; }
-    bool uses_utf8() const { return (raw_flags & 0x0800) != 0; }
-};
+    // Carry-less multiply, with SSE4.1 for the CRC-32 kernel
+    bool pclmul {false};
 
-// Packed structures for direct casting from ZIP file data
-#pragma pack(push, 1)
-// Local file header structure (packed for direct casting)
-struct zip_file_header {
-    uint16_t version;
-    uint16_t raw_flags;
-    uint16_t compression;
-    uint32_t dos_time;
-    uint32_t crc32;
-    uint32_t compressed_size;
-    uint32_t uncompressed_size;
-    uint16_t filename_length;
-    uint16_t extra_field_length;
-    // Marker for the start of variable-length data
-    // The actual filename follows this header in the ZIP file
-    char file_name[0];
-};
+    static zip_cpu const & get() {
+        static const zip_cpu cpu = detect(); return cpu;
+    }
 
-// Central directory entry structure (packed for direct casting)
-struct zip_dir_entry {
-    uint16_t version_made_by;
-    uint16_t version_needed;
-    uint16_t raw_flags;
-    uint16_t compression;
-    uint32_t dos_time;
-    uint32_t crc32;
-    uint32_t compressed_size;
-    uint32_t uncompressed_size;
-    uint16_t filename_length;
-    uint16_t extra_field_length;
-    uint16_t comment_length;
-    uint16_t disk_number_start;
-    uint16_t internal_file_attributes;
-    uint32_t external_file_attributes;
-    uint32_t local_header_offset;
-    // Marker for the start of variable-length data
-    // The actual filename follows this header in the ZIP file
-    char file_name[0];
-};
+private:
+    static zip_cpu detect() {
+        zip_cpu r;
+
+#if ZIP_X86
+        unsigned int regs[4] {0}; auto cpuid = [&regs](unsigned int leaf, unsigned int subleaf) {
+#    if defined(_MSC_VER)
+            __cpuidex(reinterpret_cast<int *>(regs), leaf, subleaf);
+#    else
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#    endif
+        };
+
+        cpuid(0, 0); unsigned int max_leaf = regs[0];
+
+        cpuid(1, 0); bool osxsave = (regs[2] & (1u << 27)) != 0, avx = (regs[2] & (1u << 28)) != 0;
+
+        r.pclmul = (regs[2] & (1u << 1)) != 0 && (regs[2] & (1u << 19)) != 0;
+
+        // The OS must save the YMM registers on context switch
+        bool ymm_state = false; if(osxsave) {
+#    if defined(_MSC_VER) && !defined(__clang__)
+            ymm_state = (_xgetbv(0) & 6) == 6;
+#    else
+            unsigned int eax, edx; __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            ymm_state = (eax & 6) == 6;
+#    endif
+        }
 
-struct zip_fake_dir_entry : zip_dir_entry {
-    char xfile_name[1024];
-};
+        if(max_leaf >= 7 && avx && ymm_state) {
+            cpuid(7, 0); r.avx2 = (regs[1] & (1u << 5)) != 0;
+        }
+#endif
 
-// End of central directory record structure (packed for direct casting)
-struct zip_end_of_central_dir {
-    uint16_t disk_number;
-    uint16_t central_dir_disk_number;
-    uint16_t num_entries_on_disk;
-    uint16_t num_entries_total;
-    uint32_t central_dir_size;
-    uint32_t central_dir_offset;
-    uint16_t comment_length;
+        return r;
+    }
 };
 
-// ZIP64 end of central directory locator structure (packed for direct casting)
-struct zip64_end_of_central_dir_locator {
-    uint32_t disk_number_with_zip64_end;
-    uint64_t relative_offset_of_zip64_end;
-    uint32_t total_number_of_disks;
-};
+// Signature search over the archive buffer, vectorized with runtime dispatch
+// A 4-byte signature is matched by comparing four byte-shifted loads against its bytes,
+// so each iteration tests 16 (SSE2) or 32 (AVX2) candidate positions at once.
+struct zip_scan {
+    typedef size_t (*scan_fn)(const uint8_t *, size_t, uint32_t);
 
-// ZIP64 end of central directory record structure (packed for direct casting)
-struct zip64_end_of_central_dir {
-    uint64_t size_of_record;
-    uint16_t version_made_by;
-    uint16_t version_needed;
-    uint32_t disk_number;
-    uint32_t central_dir_disk_number;
-    uint64_t num_entries_on_disk;
-    uint64_t num_entries_total;
-    uint64_t central_dir_size;
-    uint64_t central_dir_offset;
-};
+    // Find the last position of a 4-byte little-endian signature in data[0, size)
+    // Returns the position or SIZE_MAX if not found
+    static size_t rfind(const uint8_t * data, size_t size, uint32_t signature) {
+        static const scan_fn fn = zip_cpu::get().avx2 ? rfind_avx2 : rfind_sse2; return fn(data, size, signature);
+    }
 
-// File info structure for retrieving information about files in the archive
-#pragma pack(pop)
+    // Find the first position of a 4-byte little-endian signature in data[0, size)
+    // Returns the position or SIZE_MAX if not found
+    static size_t find(const uint8_t * data, size_t size, uint32_t signature) {
+        static const scan_fn fn = zip_cpu::get().avx2 ? find_avx2 : find_sse2; return fn(data, size, signature);
+    }
 
-// File info structure for retrieving information about files in the archive
-struct zip_file_info {
-    // Direct reference to the filename in the original data
-    std::string_view filename;
+    static bool match(const uint8_t * p, uint32_t signature) {
+        uint32_t v; memcpy(&v, p, 4); return v == signature;
+    }
 
-    bool is_directory {false};
+    static size_t rfind_scalar(const uint8_t * data, size_t size, uint32_t signature) {
+        for(size_t i = size; i >= 4; --i) {
+            if(match(data + i - 4, signature)) return i - 4;
+        }
 
-    size_t compressed_size {0};
-    size_t uncompressed_size {0};
+        return SIZE_MAX;
+    }
 
-    // Modification time (DOS format time)
-    uint32_t mod_time {0};
+    static size_t find_scalar(const uint8_t * data, size_t size, uint32_t signature) {
+        for(size_t i = 0; i + 4 <= size; ++i) {
+            if(match(data + i, signature)) return i;
+        }
 
-    // Compression method
-    zip_compression_method compression {zip_compression_method::NONE};
+        return SIZE_MAX;
+    }
 
-    // Pointer to compressed data
-    const uint8_t * raw_ptr {nullptr};
+#if ZIP_X86
+    // Bit i of the result is set if the signature starts at p + i
+    static uint32_t match_mask_sse2(const uint8_t * p, uint32_t signature) {
+        __m128i m = _mm_and_si128(
+            _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), _mm_set1_epi8(static_cast<char>(signature))),
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1)), _mm_set1_epi8(static_cast<char>(signature >> 8)))),
+            _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 2)), _mm_set1_epi8(static_cast<char>(signature >> 16))),
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 3)), _mm_set1_epi8(static_cast<char>(signature >> 24)))));
+
+        return static_cast<uint32_t>(_mm_movemask_epi8(m));
+    }
 
-    // Additional pointer to data
-    const uint8_t * data_ptr {nullptr};
+    ZIP_TARGET("avx2") static uint32_t match_mask_avx2(const uint8_t * p, uint32_t signature) {
+        __m256i m = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), _mm256_set1_epi8(static_cast<char>(signature))),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1)), _mm256_set1_epi8(static_cast<char>(signature >> 8)))),
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 2)), _mm256_set1_epi8(static_cast<char>(signature >> 16))),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 3)), _mm256_set1_epi8(static_cast<char>(signature >> 24)))));
 
-    // Default constructor
-    zip_file_info() = default;
+        return static_cast<uint32_t>(_mm256_movemask_epi8(m));
+    }
 
-    // Disable copy constructor
-    zip_file_info(const zip_file_info &) = delete;
+    static int highest_bit(uint32_t x) {
+#    if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long i; _BitScanReverse(&i, x); return static_cast<int>(i);
+#    else
+        return 31 - __builtin_clz(x);
+#    endif
+    }
 
-    // Disable copy assignment
-    zip_file_info & operator=(const zip_file_info &) = delete;
+    static int lowest_bit(uint32_t x) {
+#    if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long i; _BitScanForward(&i, x); return static_cast<int>(i);
+#    else
+        return __builtin_ctz(x);
+#    endif
+    }
 
-    // Move constructor
-    zip_file_info(zip_file_info && other) noexcept {
-        move_from(std::move(other));
+    // A block at p tests candidates p .. p + W - 1 and reads up to p + W + 2
+    static size_t rfind_sse2(const uint8_t * data, size_t size, uint32_t signature) {
+        size_t n = size; while(n >= 16 + 3) {
+            size_t p = n - 16 - 3; if(uint32_t mask = match_mask_sse2(data + p, signature)) {
+                return p + highest_bit(mask);
+            }
+
+            n -= 16;
+        }
+
+        return rfind_scalar(data, n, signature);
     }
 
-    // Move assignment
-    zip_file_info & operator=(zip_file_info && other) noexcept {
-        if(this != &other) {
-            free_resources();
-            move_from(std::move(other));
+    ZIP_TARGET("avx2") static size_t rfind_avx2(const uint8_t * data, size_t size, uint32_t signature) {
+        size_t n = size; while(n >= 32 + 3) {
+            size_t p = n - 32 - 3; if(uint32_t mask = match_mask_avx2(data + p, signature)) {
+                return p + highest_bit(mask);
+            }
+
+            n -= 32;
         }
-        return *this;
+
+        return rfind_scalar(data, n, signature);
     }
 
-    // Destructor to free allocated memory
-    ~zip_file_info() {
-        free_resources();
+    static size_t find_sse2(const uint8_t * data, size_t size, uint32_t signature) {
+        size_t p = 0; for(; p + 16 + 3 <= size; p += 16) {
+            if(uint32_t mask = match_mask_sse2(data + p, signature)) {
+                return p + lowest_bit(mask);
+            }
+        }
+
+        size_t r = find_scalar(data + p, size - p, signature); return r == SIZE_MAX ? r : p + r;
     }
 
-    // Helper method to free resources
-    void free_resources() {
-        // Only free data_ptr if it's not null and different from raw_ptr
-        if(data_ptr != nullptr && data_ptr != raw_ptr) {
-            free(const_cast<uint8_t *>(data_ptr));
-            data_ptr = nullptr;
+    ZIP_TARGET("avx2") static size_t find_avx2(const uint8_t * data, size_t size, uint32_t signature) {
+        size_t p = 0; for(; p + 32 + 3 <= size; p += 32) {
+            if(uint32_t mask = match_mask_avx2(data + p, signature)) {
+                return p + lowest_bit(mask);
+            }
         }
+
+        size_t r = find_scalar(data + p, size - p, signature); return r == SIZE_MAX ? r : p + r;
     }
+#else
+    static size_t rfind_sse2(const uint8_t * data, size_t size, uint32_t signature) { return rfind_scalar(data, size, signature); }
+    static size_t rfind_avx2(const uint8_t * data, size_t size, uint32_t signature) { return rfind_scalar(data, size, signature); }
+    static size_t find_sse2(const uint8_t * data, size_t size, uint32_t signature) { return find_scalar(data, size, signature); }
+    static size_t find_avx2(const uint8_t * data, size_t size, uint32_t signature) { return find_scalar(data, size, signature); }
+#endif
+};
 
-    // Helper method to move resources from another instance
-    void move_from(zip_file_info && other) {
-        filename = std::move(other.filename);
-        is_directory = other.is_directory;
-        compressed_size = other.compressed_size;
-        uncompressed_size = other.uncompressed_size;
-        mod_time = other.mod_time;
-        compression = other.compression;
-        raw_ptr = other.raw_ptr;
-        data_ptr = other.data_ptr;
+// How decompressed data is checked against the CRC-32 recorded in the central directory
+enum class zip_verify {
+    NONE, // Not checked
+    FULL, // Whole-entry decompression fails on a mismatch before the data is returned
+    LAZY, // Whole entries are returned unchecked, verify() checks them when the caller asks
+};
 
-        // Reset other's pointers
-        other.raw_ptr = nullptr;
-        other.data_ptr = nullptr;
+// CRC-32 of decompressed data, folded with PCLMULQDQ or the ARMv8 CRC32 instructions when there
+// are, zlib's table-driven crc32 otherwise. Streams fold it into their output loop, whole entries
+// are checked in a second pass while the data is still hot in cache.
+struct zip_crc32 {
+    typedef uint32_t (*update_fn)(uint32_t, const uint8_t *, size_t);
+
+    // How entries are checked, set it before decompressing if at all
+    static zip_verify & verify() {
+        static zip_verify v = zip_verify::FULL; return v;
     }
 
-    // Returns decompressed data or raw data if no compression
-    uint8_t * data() {
-        // If data_ptr is already set, return it
-        if(data_ptr) {
-            return const_cast<uint8_t *>(data_ptr);
+    // CRC-32 of data continuing from crc, 0 to start
+    static uint32_t update(uint32_t crc, const uint8_t * data, size_t size) {
+#if ZIP_ARM_CRC
+        return update_arm(crc, data, size);
+#else
+        static const update_fn fn = zip_cpu::get().pclmul ? update_pclmul : update_zlib; return fn(crc, data, size);
+#endif
+    }
+
+    static uint32_t update_zlib(uint32_t crc, const uint8_t * data, size_t size) {
+        // zlib counts in 32 bits
+        while(size) {
+            uInt n = static_cast<uInt>(std::min<size_t>(size, 1u << 30)); crc = static_cast<uint32_t>(crc32(crc, data, n)); data += n; size -= n;
         }
 
-        // If no raw data or this is a directory, return nullptr
-        if(!raw_ptr || is_directory) {
-            return nullptr;
+        return crc;
+    }
+
+#if ZIP_X86
+    // Blocks of 64 bytes are folded four lanes at a time, the rest byte by byte in zlib
+    ZIP_TARGET("pclmul,sse4.1") static uint32_t update_pclmul(uint32_t crc, const uint8_t * data, size_t size) {
+        if(size < 64) return update_zlib(crc, data, size);
+
+        size_t folded = size & ~size_t(15); crc = ~fold_pclmul(data, folded, ~crc);
+
+        return update_zlib(crc, data + folded, size - folded);
+    }
+
+    // Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ", with the bit-reflected
+    // constants of the CRC-32 polynomial as zlib uses them in Chromium. size is a multiple of 16, at least 64.
+    ZIP_TARGET("pclmul,sse4.1") static uint32_t fold_pclmul(const uint8_t * data, size_t size, uint32_t crc) {
+        alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+        alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+        alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+        alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+        auto load = [](const uint8_t * p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); };
+
+        __m128i x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(static_cast<int>(crc))), x2 = load(data + 16), x3 = load(data + 32), x4 = load(data + 48);
+
+        __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2)); data += 64; size -= 64;
+
+        for(; size >= 64; data += 64, size -= 64) {
+            x1 = fold(x1, k, load(data)); x2 = fold(x2, k, load(data + 16)); x3 = fold(x3, k, load(data + 32)); x4 = fold(x4, k, load(data + 48));
         }
 
-        // If no compression, just set data_ptr to raw_ptr and return it
-        if(compression == zip_compression_method::NONE) {
-            data_ptr = raw_ptr;
-            return const_cast<uint8_t *>(data_ptr);
+        // Four lanes into one, then the remaining blocks of 16
+        k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4)); x1 = fold(fold(fold(x1, k, x2), k, x3), k, x4);
+
+        for(; size >= 16; data += 16, size -= 16) {
+            x1 = fold(x1, k, load(data));
         }
 
-        // Need to decompress the data
-        if(compression == zip_compression_method::DEFLATED) {
-            // Allocate memory for decompressed data
-            uint8_t * decompressed = static_cast<uint8_t *>(malloc(uncompressed_size));
-
-            // Set up zlib stream
-            z_stream strm; {
-                strm.zalloc = Z_NULL;
-                strm.zfree = Z_NULL;
-                strm.opaque = Z_NULL;
-                strm.avail_in = static_cast<uInt>(compressed_size);
-                strm.next_in = const_cast<Bytef *>(raw_ptr);
-                strm.avail_out = static_cast<uInt>(uncompressed_size);
-                strm.next_out = decompressed;
-            }
-
-            // Initialize with negative windowBits to indicate raw deflate data (no zlib header)
-            inflateInit2(&strm, -MAX_WBITS);
-
-            // Decompress
-            int ret = inflate(&strm, Z_FINISH);
-            inflateEnd(&strm);
-
-            if(ret != Z_STREAM_END) {
-                // Decompression failed
-                free(decompressed);
-                return nullptr;
-            }
+        // 128 bits to 64
+        __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0); x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k, 0x10));
 
-            // Store the decompressed data pointer
-            data_ptr = decompressed;
-            return const_cast<uint8_t *>(data_ptr);
+        k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0)); x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00), _mm_srli_si128(x1, 4));
+
+        // Barrett reduction to 32 bits
+        k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+
+        __m128i t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10); t = _mm_clmulepi64_si128(_mm_and_si128(t, mask), k, 0x00);
+
+        return static_cast<uint32_t>(_mm_extract_epi32(_mm_xor_si128(x1, t), 1));
+    }
+
+    // Fold a lane over 128 bits and add the next one
+    ZIP_TARGET("pclmul,sse4.1") static __m128i fold(__m128i x, __m128i k, __m128i next) {
+        return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00)), next);
+    }
+#else
+    static uint32_t update_pclmul(uint32_t crc, const uint8_t * data, size_t size) { return update_zlib(crc, data, size); }
+#endif
+
+#if ZIP_ARM_CRC
+    static uint32_t update_arm(uint32_t crc, const uint8_t * data, size_t size) {
+        crc = ~crc; for(; size && (reinterpret_cast<uintptr_t>(data) & 7); --size) {
+            crc = __crc32b(crc, *data++);
         }
 
-        // Unsupported compression method
-        return nullptr;
+        for(; size >= 8; data += 8, size -= 8) {
+            uint64_t v; memcpy(&v, data, 8); crc = __crc32d(crc, v);
+        }
+
+        for(; size; --size) crc = __crc32b(crc, *data++);
+
+        return ~crc;
     }
+#endif
 };
 
-struct zip_archive {
-    // Data members
-    uint8_t * m_data = nullptr;   // Pointer to the beginning of the buffer
-    size_t m_size = 0;            // Size of the entire buffer
-    size_t m_zip_base_offset = 0; // Offset to the beginning of the ZIP archive within the buffer
-    size_t m_zip_central_dir_offset = 0;
+// Run f(begin, end) over [0, n) split into contiguous ranges, one per thread
+struct zip_parallel {
+    static unsigned concurrency(unsigned threads) {
+        if(threads == 0) threads = std::thread::hardware_concurrency();
 
-    // Central directory information
-    const uint8_t * m_central_dir = nullptr; // Pointer to the central directory
-    size_t m_num_entries = 0;                // Number of entries in the central directory
-    std::vector<size_t> m_entry_offsets;     // Offsets of each entry in the central directory
+        return std::max(1u, threads);
+    }
 
-    // ZIP64 support
-    bool m_is_zip64 = false;                                 // Whether this is a ZIP64 archive
+    template<typename F>
+    static void for_range(size_t n, unsigned threads, F && f) {
+        threads = static_cast<unsigned>(std::min<size_t>(concurrency(threads), std::max<size_t>(n, 1)));
 
-    zip_archive() = default;
+        if(threads == 1) {
+            f(size_t(0), n); return;
+        }
 
-    zip_archive(const void * data, size_t size) { open((uint8_t *)data, size); }
+        std::vector<std::thread> workers; workers.reserve(threads - 1);
 
-    zip_archive(std::string_view const & x) { open((uint8_t *)x.data(), x.size()); }
+        for(unsigned t = 1; t < threads; ++t) {
+            workers.emplace_back([&f, n, threads, t] { f(n * t / threads, n * (t + 1) / threads); });
+        }
 
-    // Find the position of the end of central directory record
-    // Returns the position of the signature or SIZE_MAX if not found
-    static size_t find_end_of_central_dir(uint8_t * data, size_t size) {
-        // ZIP end of central directory signature is 'PK\x05\x06'
-        // It must be followed by a variable-length comment, so we need to search for it
-        // from the end of the file
+        f(size_t(0), n / threads);
 
-        // Minimum size of end of central directory record is 22 bytes
-        // 4 bytes signature + 18 bytes data + variable length comment
-        if(size < 22) return SIZE_MAX;
+        for(auto & w : workers) w.join();
+    }
+};
 
-        // Search for the signature from the end of the file
-        // The maximum size of the comment is 65535 bytes, so we don't need to search
-        // more than that distance from the end
-        size_t search_size = std::min(size, size_t(65557)); // 65535 + 22
+// Memory for decompressed data and zlib state, from mimalloc when it is part of the build
+struct zip_memory {
+    static void * allocate(size_t size) {
+#ifdef MI_MALLOC_VERSION
+        return mi_malloc(size);
+#else
+        return malloc(size);
+#endif
+    }
+
+    static void release(void * p) {
+#ifdef MI_MALLOC_VERSION
+        mi_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    // Route the allocations of a z_stream before it is initialized
+    static void setup(z_stream & strm) {
+        strm.zalloc = [](voidpf, uInt items, uInt size) -> voidpf { return allocate(static_cast<size_t>(items) * size); };
+        strm.zfree = [](voidpf, voidpf p) { release(p); };
+        strm.opaque = Z_NULL;
+    }
+};
+
+// Raw inflate context kept by each thread for one-shot decompression
+// inflateInit2 allocates zlib's state and its 32 KB window, which costs more than inflating a
+// small entry, so the context is initialized once and reset with inflateReset2 afterwards.
+struct zip_inflate_context {
+    z_stream strm {};
+    bool ready {false};
+
+    ~zip_inflate_context() {
+        if(ready) inflateEnd(&strm);
+    }
 
-        for(size_t i = 0; i < search_size - 4; ++i) {
-            size_t pos = size - 4 - i;
-            if(data[pos] == 'P' && data[pos + 1] == 'K' &&
-                data[pos + 2] == 0x05 && data[pos + 3] == 0x06) {
-                return pos;
+    // The context of the calling thread ready for a new stream, nullptr if zlib fails
+    static z_stream * local() {
+        thread_local zip_inflate_context context; if(!context.ready) {
+            zip_memory::setup(context.strm); if(inflateInit2(&context.strm, -MAX_WBITS) != Z_OK) {
+                return nullptr;
             }
+
+            context.ready = true; return &context.strm;
         }
 
-        return SIZE_MAX;
+        return inflateReset2(&context.strm, -MAX_WBITS) == Z_OK ? &context.strm : nullptr;
     }
+};
 
-    // Find ZIP64 end of central directory locator
-    // Returns the position of the signature or SIZE_MAX if not found
-    static size_t find_zip64_end_of_central_dir_locator(uint8_t * data, size_t size, size_t eocd_pos) {
-        // ZIP64 end of central directory locator is 20 bytes and precedes the EOCD
-        if(eocd_pos < 20) return SIZE_MAX;
+// Decoders for whole entries, whose uncompressed size is known from the central directory
+enum class zip_decoder { ZLIB, LIBDEFLATE };
+
+// One-shot inflate of raw deflate data into a buffer of exactly its uncompressed size
+// zlib is always there and also serves streaming reads. libdeflate decodes a whole buffer in one
+// pass, which is 2-3x faster, and is the default when the build has it.
+struct zip_inflate {
+    static bool available([[maybe_unused]] zip_decoder decoder) {
+#ifdef ZIP_WITH_LIBDEFLATE
+        return true;
+#else
+        return decoder == zip_decoder::ZLIB;
+#endif
+    }
 
-        size_t locator_pos = eocd_pos - 20;
+    // Decoder of one-shot decompression, set it before decompressing if at all
+    static zip_decoder & decoder() {
+        static zip_decoder d = available(zip_decoder::LIBDEFLATE) ? zip_decoder::LIBDEFLATE : zip_decoder::ZLIB; return d;
+    }
 
-        // Check for ZIP64 end of central directory locator signature
-        if(data[locator_pos] == 'P' && data[locator_pos + 1] == 'K' &&
-            data[locator_pos + 2] == 0x06 && data[locator_pos + 3] == 0x07) {
-            return locator_pos;
+    static bool one_shot(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size, [[maybe_unused]] zip_decoder decoder = zip_inflate::decoder()) {
+#ifdef ZIP_WITH_LIBDEFLATE
+        if(decoder == zip_decoder::LIBDEFLATE) return one_shot_libdeflate(src, src_size, dst, dst_size);
+#endif
+        return one_shot_zlib(src, src_size, dst, dst_size);
+    }
+
+    static bool one_shot_zlib(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+        z_stream * strm = zip_inflate_context::local(); if(!strm) {
+            return false;
         }
 
-        return SIZE_MAX;
-    }
+        strm->next_in = const_cast<Bytef *>(src); strm->next_out = dst;
 
-    // Find ZIP64 end of central directory record
+        // zlib counts in 32 bits, larger entries go through in chunks
+        int ret = Z_OK; while(ret == Z_OK) {
+            uInt in = static_cast<uInt>(std::min<size_t>(src_size, 1u << 30)), out = static_cast<uInt>(std::min<size_t>(dst_size, 1u << 30)); {
+                strm->avail_in = in; strm->avail_out = out;
+            }
+
+            ret = inflate(strm, in == src_size && out == dst_size ? Z_FINISH : Z_NO_FLUSH);
+
+            src_size -= in - strm->avail_in; dst_size -= out - strm->avail_out;
+        }
+
+        return ret == Z_STREAM_END && dst_size == 0;
+    }
+
+    // Inflate only the first dst_size bytes, no more than the data holds
+    static bool prefix(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+        z_stream * strm = zip_inflate_context::local(); if(!strm) {
+            return false;
+        }
+
+        strm->next_in = const_cast<Bytef *>(src); strm->next_out = dst;
+
+        int ret = Z_OK; while(ret == Z_OK && dst_size) {
+            uInt in = static_cast<uInt>(std::min<size_t>(src_size, 1u << 30)), out = static_cast<uInt>(std::min<size_t>(dst_size, 1u << 30)); {
+                strm->avail_in = in; strm->avail_out = out;
+            }
+
+            ret = inflate(strm, Z_NO_FLUSH);
+
+            src_size -= in - strm->avail_in; dst_size -= out - strm->avail_out;
+        }
+
+        return (ret == Z_OK || ret == Z_STREAM_END) && dst_size == 0;
+    }
+
+#ifdef ZIP_WITH_LIBDEFLATE
+    static bool one_shot_libdeflate(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+        // One decompressor per thread, it keeps no state between calls
+        struct context {
+            libdeflate_decompressor * d {libdeflate_alloc_decompressor()};
+
+            ~context() { if(d) libdeflate_free_decompressor(d); }
+        };
+
+        thread_local context c; if(!c.d) {
+            return false;
+        }
+
+        return libdeflate_deflate_decompress(c.d, src, src_size, dst, dst_size, nullptr) == LIBDEFLATE_SUCCESS;
+    }
+#endif
+};
+
+// Access points into the deflate stream of an entry, each one restarts decompression at its output
+// offset from a snapshot of the 32 KB window (as in zlib's zran example). A stream collects them
+// about every span bytes while it decompresses the entry; complete once it reached the end.
+struct zip_access_index {
+    static constexpr uint64_t DEFAULT_SPAN = 4 << 20;
+    static constexpr size_t WINDOW_SIZE = 32768;
+
+    struct point_t {
+        uint64_t in;  // Compressed bytes consumed, the last one partly when bits is not zero
+        uint64_t out; // Uncompressed offset
+        uint8_t bits; // Unused bits of the byte at in - 1
+        std::vector<uint8_t> window;
+    };
+
+    uint64_t span {DEFAULT_SPAN};
+    std::vector<point_t> points; // In output order
+    bool complete {false};
+
+    // The last point at or before offset, nullptr if there is none
+    const point_t * find(uint64_t offset) const {
+        auto it = std::upper_bound(points.begin(), points.end(), offset, [](uint64_t o, point_t const & p) { return o < p.out; });
+
+        return it == points.begin() ? nullptr : &*(it - 1);
+    }
+
+    size_t memory_usage() const {
+        size_t r = sizeof(*this) + points.capacity() * sizeof(point_t); for(auto & p : points) {
+            r += p.window.capacity();
+        }
+
+        return r;
+    }
+};
+
+// Speculative parallel inflate of one large deflate stream, after pugz
+// The compressed data is cut into chunks and each chunk is decoded from the first dynamic block
+// header found after its cut. Until the chunks before it are decoded, its back references into the
+// unknown 32 KB window are kept as markers. A chunk has to end exactly where the next one was found
+// to start, otherwise one_shot fails and the caller decodes sequentially. The same chunks also
+// index a stream, their starts becoming access points, so that a long skip is not inflated on one core.
+struct zip_pinflate {
+    static constexpr size_t WINDOW_SIZE = 32768;
+
+    // Compressed bytes per chunk below which the search does not pay
+    static constexpr size_t MIN_CHUNK = 1 << 20;
+
+    // How far past a cut to look for a block start, deflaters rarely write blocks this long
+    static constexpr size_t SEARCH_LIMIT = 256 << 10;
+
+    // Entries from this uncompressed size on are decoded in parallel when there are several cores, as
+    // are skips of a stream this far past its access points
+    static size_t & threshold() {
+        static size_t t = 64 << 20; return t;
+    }
+
+    static constexpr uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static constexpr uint16_t DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static constexpr uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    struct bit_reader {
+        const uint8_t * data;
+        size_t size;
+        uint64_t pos; // In bits
+
+        // Up to 32 bits at the current position, zeros past the end
+        uint32_t peek(unsigned n) const {
+            size_t byte = static_cast<size_t>(pos >> 3); uint64_t v = 0; if(byte + 8 <= size) {
+                memcpy(&v, data + byte, 8);
+            } else if(byte < size) {
+                memcpy(&v, data + byte, size - byte);
+            }
+
+            return static_cast<uint32_t>((v >> (pos & 7)) & ((uint64_t(1) << n) - 1));
+        }
+
+        uint32_t bits(unsigned n) {
+            uint32_t v = peek(n); pos += n; return v;
+        }
+
+        bool overrun() const { return pos > uint64_t(size) * 8; }
+    };
+
+    // Canonical Huffman code, a table for short codes and puff's walk over the counts for the rest
+    struct huffman {
+        static constexpr unsigned FAST_BITS = 10;
+
+        uint16_t fast[1 << FAST_BITS]; // Symbol << 4 | code length, 0 for longer codes
+        uint16_t count[16];
+        uint16_t symbol[288];
+
+        // Codes must be complete, but for a lone code or none where allow_incomplete
+        bool build(const uint8_t * lengths, unsigned n, bool allow_incomplete) {
+            memset(count, 0, sizeof(count)); for(unsigned i = 0; i < n; ++i) {
+                ++count[lengths[i]];
+            }
+
+            count[0] = 0; int left = 1; unsigned total = 0; for(unsigned len = 1; len < 16; ++len) {
+                left = (left << 1) - count[len]; total += count[len]; if(left < 0) return false;
+            }
+
+            if(left > 0 && !(allow_incomplete && total <= 1)) return false;
+
+            uint16_t offsets[16] {0}; for(unsigned len = 1; len < 15; ++len) {
+                offsets[len + 1] = offsets[len] + count[len];
+            }
+
+            for(unsigned i = 0; i < n; ++i) {
+                if(lengths[i]) symbol[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+            }
+
+            // Codes are read from their most significant bit on, the table is indexed by the bits as read
+            memset(fast, 0, sizeof(fast)); unsigned code = 0, index = 0; for(unsigned len = 1; len <= FAST_BITS; ++len) {
+                for(unsigned k = 0; k < count[len]; ++k, ++code) {
+                    unsigned reversed = 0; for(unsigned b = 0; b < len; ++b) reversed |= ((code >> b) & 1) << (len - 1 - b);
+
+                    for(unsigned r = reversed; r < (1u << FAST_BITS); r += 1u << len) {
+                        fast[r] = static_cast<uint16_t>(symbol[index + k] << 4 | len);
+                    }
+                }
+
+                index += count[len]; code <<= 1;
+            }
+
+            return true;
+        }
+
+        int decode(bit_reader & br) const {
+            if(uint32_t e = fast[br.peek(FAST_BITS)]) {
+                br.pos += e & 15; return static_cast<int>(e >> 4);
+            }
+
+            uint32_t bits = br.peek(15); int code = 0, first = 0, index = 0; for(unsigned len = 1; len < 16; ++len) {
+                code |= (bits >> (len - 1)) & 1; int n = count[len]; if(code - n < first) {
+                    br.pos += len; return symbol[index + (code - first)];
+                }
+
+                index += n; first = (first + n) << 1; code <<= 1;
+            }
+
+            return -1;
+        }
+    };
+
+    // Decoded chunk, head values from 256 on stand for byte (value - 256) of the window before it
+    // Once the last 32 KB of output hold no marker the chunk goes on in bytes, its tail starting
+    // with those 32 KB, so the head stays short unless the data keeps referring back.
+    struct chunk_t {
+        uint64_t begin {0}, end {UINT64_MAX}; // Bit positions, end is where the next chunk begins
+        std::vector<uint16_t> head;
+        std::vector<uint8_t> tail;
+        size_t tail_base {0}; // Output offset of the tail
+        size_t size {0};
+        bool ok {false};
+        bool deferred {false}; // Decoded again with its window, the head would not end
+    };
+
+    static bool read_tables(bit_reader & br, huffman & lit, huffman & dist) {
+        static constexpr uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        unsigned nlen = br.bits(5) + 257, ndist = br.bits(5) + 1, ncode = br.bits(4) + 4; if(nlen > 286 || ndist > 30) {
+            return false;
+        }
+
+        uint8_t lengths[320] {0}; for(unsigned i = 0; i < ncode; ++i) {
+            lengths[order[i]] = static_cast<uint8_t>(br.bits(3));
+        }
+
+        // Most wrong guesses of a block start end here, before any table is built
+        int left = 1; for(unsigned len = 1; len < 8; ++len) {
+            left <<= 1; for(unsigned i = 0; i < 19; ++i) left -= lengths[i] == len;
+
+            if(left < 0) return false;
+        }
+
+        huffman codes; if(left != 0 || !codes.build(lengths, 19, false)) {
+            return false;
+        }
+
+        memset(lengths, 0, 19); for(unsigned index = 0; index < nlen + ndist;) {
+            int sym = codes.decode(br); if(sym < 0) return false;
+
+            if(sym < 16) {
+                lengths[index++] = static_cast<uint8_t>(sym); continue;
+            }
+
+            uint8_t len = 0; unsigned repeat; if(sym == 16) {
+                if(index == 0) return false;
+
+                len = lengths[index - 1]; repeat = 3 + br.bits(2);
+            } else {
+                repeat = sym == 17 ? 3 + br.bits(3) : 11 + br.bits(7);
+            }
+
+            if(index + repeat > nlen + ndist) return false;
+
+            while(repeat--) lengths[index++] = len;
+        }
+
+        if(lengths[256] == 0 || br.overrun()) return false;
+
+        return lit.build(lengths, nlen, true) && dist.build(lengths + nlen, ndist, true);
+    }
+
+    static huffman const & fixed_lit() {
+        static const huffman h = [] {
+            uint8_t lengths[288]; memset(lengths, 8, 144); memset(lengths + 144, 9, 112); memset(lengths + 256, 7, 24); memset(lengths + 280, 8, 8);
+
+            huffman r; r.build(lengths, 288, false); return r;
+        }();
+
+        return h;
+    }
+
+    static huffman const & fixed_dist() {
+        static const huffman h = [] {
+            uint8_t lengths[30]; memset(lengths, 5, 30);
+
+            huffman r; r.build(lengths, 30, true); return r;
+        }();
+
+        return h;
+    }
+
+    // Decode blocks from br.pos to the bit position end, or through the final block when end is
+    // UINT64_MAX, handing the output to literal(byte) and copy(length, distance), both false on error
+    template<typename Literal, typename Copy, typename Stop>
+    static bool decode_blocks(bit_reader & br, uint64_t end, Literal && literal, Copy && copy, Stop && stop) {
+        auto lit = std::make_unique<huffman>(), dist = std::make_unique<huffman>();
+
+        while(br.pos != end) {
+            // Running past the next chunk means its start was guessed wrong
+            if(br.pos > end || br.overrun() || stop()) return false;
+
+            uint32_t final = br.bits(1), type = br.bits(2);
+
+            if(type == 0) {
+                br.pos = (br.pos + 7) & ~uint64_t(7); uint32_t len = br.bits(16), nlen = br.bits(16);
+
+                if((len ^ 0xFFFF) != nlen || (br.pos >> 3) + len > br.size) return false;
+
+                for(uint32_t k = 0; k < len; ++k) {
+                    if(!literal(br.data[(br.pos >> 3) + k])) return false;
+                }
+
+                br.pos += uint64_t(len) * 8;
+            } else {
+                huffman const * l = &fixed_lit(), * d = &fixed_dist(); if(type == 2) {
+                    if(!read_tables(br, *lit, *dist)) return false;
+
+                    l = lit.get(); d = dist.get();
+                } else if(type != 1) {
+                    return false;
+                }
+
+                while(true) {
+                    int sym = l->decode(br); if(sym < 0 || br.overrun()) return false;
+
+                    if(sym < 256) {
+                        if(!literal(static_cast<uint8_t>(sym))) return false;
+
+                        continue;
+                    }
+
+                    if(sym == 256) break;
+
+                    sym -= 257; if(sym >= 29) return false;
+
+                    size_t len = LENGTH_BASE[sym] + br.bits(LENGTH_EXTRA[sym]);
+
+                    int ds = d->decode(br); if(ds < 0 || ds >= 30) return false;
+
+                    if(!copy(len, DIST_BASE[ds] + br.bits(DIST_EXTRA[ds]))) return false;
+                }
+            }
+
+            // Only the last chunk ends the stream
+            if(final) return end == UINT64_MAX;
+        }
+
+        return true;
+    }
+
+    // Decode a chunk without its window, the first chunk has none and writes bytes from the start
+    // expected sizes the tail. A head that grows past max_head defers the chunk rather than holding
+    // 2 bytes a byte, it is decoded again once the output before it is known.
+    static bool decode(chunk_t & c, const uint8_t * src, size_t size, bool first, size_t expected, std::atomic<bool> & failed, size_t max_head) {
+        bit_reader br {src, size, c.begin};
+
+        // p counts the output, last_marker is the end of the last marker in the head, t the bytes in the tail
+        bool bytes = first; size_t p = 0, last_marker = 0, t = 0;
+
+        // The tail grows by doubling, it is cut to t at the end
+        auto room = [&](size_t n) {
+            if(t + n > c.tail.size()) c.tail.resize(c.tail.empty() ? std::max<size_t>(expected + expected / 8, t + n) : std::max<size_t>(2 * c.tail.size(), t + n));
+        };
+
+        auto to_bytes = [&] {
+            c.tail_base = p - WINDOW_SIZE; room(WINDOW_SIZE); for(size_t k = 0; k < WINDOW_SIZE; ++k) {
+                c.tail[k] = static_cast<uint8_t>(c.head[c.tail_base + k]);
+            }
+
+            c.head.resize(c.tail_base); t = WINDOW_SIZE; bytes = true;
+        };
+
+        auto literal = [&](uint8_t b) {
+            if(bytes) {
+                room(1); c.tail[t++] = b; ++p; return true;
+            }
+
+            c.head.push_back(b); if(++p - last_marker >= WINDOW_SIZE) to_bytes();
+
+            return true;
+        };
+
+        auto copy = [&](size_t len, size_t distance) {
+            if(bytes) {
+                if(distance > t) return false;
+
+                room(len); uint8_t * out = c.tail.data() + t; for(size_t k = 0; k < len; ++k) out[k] = out[k - distance];
+
+                t += len;
+            } else {
+                if(distance > p + WINDOW_SIZE) return false;
+
+                for(size_t k = 0; k < len; ++k) {
+                    uint16_t v = distance <= p + k ? c.head[p + k - distance] : static_cast<uint16_t>(256 + WINDOW_SIZE + p + k - distance);
+
+                    c.head.push_back(v); if(v >= 256) last_marker = p + k + 1;
+                }
+            }
+
+            p += len; if(!bytes && p - last_marker >= WINDOW_SIZE) to_bytes();
+
+            return true;
+        };
+
+        auto stop = [&] {
+            if(c.head.size() > max_head) c.deferred = true;
+
+            return c.deferred || failed.load(std::memory_order_relaxed);
+        };
+
+        if(!decode_blocks(br, c.end, literal, copy, stop)) {
+            std::vector<uint16_t>().swap(c.head); std::vector<uint8_t>().swap(c.tail); return false;
+        }
+
+        if(!bytes) c.tail_base = p;
+
+        c.tail.resize(t); c.size = p; c.ok = true; return true;
+    }
+
+    // Follow window, the last 32 KB of output, with a decoded chunk, resolving the markers needed
+    static bool slide(std::vector<uint8_t> & window, chunk_t const & c) {
+        size_t keep = static_cast<size_t>(std::min<uint64_t>(WINDOW_SIZE, window.size() + c.size)), from = c.size - std::min(keep, c.size);
+
+        std::vector<uint8_t> next(keep); size_t k = 0; for(size_t j = window.size() - (keep - (c.size - from)); j < window.size(); ++j) {
+            next[k++] = window[j];
+        }
+
+        for(size_t j = from; j < c.size; ++j) {
+            if(j >= c.tail_base) {
+                next[k++] = c.tail[j - c.tail_base]; continue;
+            }
+
+            uint16_t v = c.head[j]; if(v < 256) {
+                next[k++] = static_cast<uint8_t>(v); continue;
+            }
+
+            // Markers count from the start of a full window, a shorter one is the end of it
+            size_t w = v - 256; if(w + window.size() < WINDOW_SIZE) return false;
+
+            next[k++] = window[w + window.size() - WINDOW_SIZE];
+        }
+
+        window.swap(next); return true;
+    }
+
+    // Decode a deferred chunk with its window, keeping only the last 32 KB of output in a ring
+    static bool decode_window(chunk_t & c, const uint8_t * src, size_t size, std::vector<uint8_t> & window) {
+        static constexpr size_t MASK = WINDOW_SIZE - 1;
+
+        bit_reader br {src, size, c.begin}; std::vector<uint8_t> ring(WINDOW_SIZE); uint64_t p = window.size(); {
+            memcpy(ring.data(), window.data(), window.size());
+        }
+
+        auto literal = [&](uint8_t b) {
+            ring[p++ & MASK] = b; return true;
+        };
+
+        auto copy = [&](size_t len, size_t distance) {
+            if(distance > p) return false;
+
+            for(size_t k = 0; k < len; ++k, ++p) ring[p & MASK] = ring[(p - distance) & MASK];
+
+            return true;
+        };
+
+        if(!decode_blocks(br, c.end, literal, copy, [] { return false; })) return false;
+
+        c.size = static_cast<size_t>(p - window.size()); window.resize(static_cast<size_t>(std::min<uint64_t>(p, WINDOW_SIZE)));
+
+        for(size_t k = 0; k < window.size(); ++k) window[k] = ring[(p - window.size() + k) & MASK];
+
+        c.ok = true; return true;
+    }
+
+    // Decode a chunk straight into dst at offset, with the output before it as its window
+    static bool decode_into(chunk_t & c, const uint8_t * src, size_t size, uint8_t * dst, size_t offset, size_t dst_size) {
+        bit_reader br {src, size, c.begin}; size_t p = offset;
+
+        auto literal = [&](uint8_t b) {
+            if(p == dst_size) return false;
+
+            dst[p++] = b; return true;
+        };
+
+        auto copy = [&](size_t len, size_t distance) {
+            if(distance > p || len > dst_size - p) return false;
+
+            for(size_t k = 0; k < len; ++k, ++p) dst[p] = dst[p - distance];
+
+            return true;
+        };
+
+        if(!decode_blocks(br, c.end, literal, copy, [] { return false; })) return false;
+
+        c.tail_base = c.size = p - offset; c.ok = true; return true;
+    }
+
+    // First bit position in [from, limit) where a dynamic block header parses and the block decodes
+    // to its end code with distances the window allows, UINT64_MAX if there is none
+    static uint64_t find_block(const uint8_t * src, size_t size, uint64_t from, uint64_t limit) {
+        auto lit = std::make_unique<huffman>(), dist = std::make_unique<huffman>();
+
+        for(uint64_t b = from; b < limit; ++b) {
+            // Not final, dynamic
+            bit_reader br {src, size, b}; if(br.peek(3) != 4) continue;
+
+            br.pos += 3; if(!read_tables(br, *lit, *dist)) continue;
+
+            bool ok = false; size_t produced = 0; while(true) {
+                int sym = lit->decode(br); if(sym < 0 || br.overrun()) break;
+
+                if(sym < 256) {
+                    ++produced; continue;
+                }
+
+                if(sym == 256) {
+                    ok = true; break;
+                }
+
+                sym -= 257; if(sym >= 29) break;
+
+                size_t len = LENGTH_BASE[sym] + br.bits(LENGTH_EXTRA[sym]);
+
+                int ds = dist->decode(br); if(ds < 0 || ds >= 30 || DIST_BASE[ds] + br.bits(DIST_EXTRA[ds]) > produced + WINDOW_SIZE) break;
+
+                produced += len;
+            }
+
+            if(ok) return b;
+        }
+
+        return UINT64_MAX;
+    }
+
+    // Inflate src into dst of exactly dst_size bytes on several threads and compute the CRC-32 of
+    // the output, false when the stream could not be split or does not decode to dst_size bytes
+    static bool one_shot(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size, unsigned threads, uint32_t & crc) {
+        threads = zip_parallel::concurrency(threads);
+
+        size_t n = std::min<size_t>(threads, src_size / MIN_CHUNK); if(n < 2) {
+            return false;
+        }
+
+        // Where each chunk but the first starts
+        std::vector<chunk_t> chunks(n); zip_parallel::for_range(n - 1, threads, [&](size_t begin, size_t end) {
+            for(size_t i = begin + 1; i < end + 1; ++i) {
+                uint64_t from = uint64_t(src_size) * i / n * 8; chunks[i].begin = find_block(src, src_size, from, std::min<uint64_t>(uint64_t(src_size) * (i + 1) / n * 8, from + SEARCH_LIMIT * 8));
+            }
+        });
+
+        // A cut without a block start soon after it is left to the previous chunk
+        chunks.erase(std::remove_if(chunks.begin() + 1, chunks.end(), [](chunk_t const & c) { return c.begin == UINT64_MAX; }), chunks.end());
+
+        if(chunks.size() < 2) return false;
+
+        for(size_t i = 0; i + 1 < chunks.size(); ++i) chunks[i].end = chunks[i + 1].begin;
+
+        // The first chunk to fail stops the others, deferred chunks do not count as failed
+        double ratio = static_cast<double>(dst_size) / static_cast<double>(src_size); std::atomic<bool> failed {false};
+
+        zip_parallel::for_range(chunks.size(), threads, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i) {
+                auto & c = chunks[i]; size_t expected = static_cast<size_t>(static_cast<double>(std::min<uint64_t>(c.end, uint64_t(src_size) * 8) - c.begin) / 8 * ratio);
+
+                if(!decode(c, src, src_size, i == 0, expected, failed, expected / 2 + WINDOW_SIZE) && !c.deferred) failed = true;
+            }
+        });
+
+        if(failed) return false;
+
+        // In order, each chunk reads its window from the output before it
+        size_t offset = 0; for(auto & c : chunks) {
+            if(c.deferred) {
+                if(!decode_into(c, src, src_size, dst, offset, dst_size)) return false;
+
+                offset += c.size; continue;
+            }
+
+            if(c.size > dst_size - offset) return false;
+
+            uint8_t * out = dst + offset; for(size_t q = 0; q < c.head.size(); ++q) {
+                uint16_t v = c.head[q]; if(v < 256) {
+                    out[q] = static_cast<uint8_t>(v); continue;
+                }
+
+                // Window bytes sit right before the chunk
+                if(offset + (v - 256) < WINDOW_SIZE) return false;
+
+                out[q] = out[static_cast<ptrdiff_t>(v - 256) - static_cast<ptrdiff_t>(WINDOW_SIZE)];
+            }
+
+            if(c.size > c.tail_base) memcpy(out + c.tail_base, c.tail.data(), c.size - c.tail_base);
+
+            std::vector<uint16_t>().swap(c.head); std::vector<uint8_t>().swap(c.tail); offset += c.size;
+        }
+
+        if(offset != dst_size) return false;
+
+        // CRC of pieces in parallel, combined in order, pieces stay under 1 GB for zlib's 32-bit lengths
+        size_t pieces = std::max<size_t>(threads, (dst_size >> 30) + 1); std::vector<uint32_t> crcs(pieces);
+
+        auto piece = [&](size_t i) { return dst_size * i / pieces; };
+
+        zip_parallel::for_range(pieces, threads, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i) crcs[i] = zip_crc32::update(0, dst + piece(i), piece(i + 1) - piece(i));
+        });
+
+        crc = 0; for(size_t i = 0; i < pieces; ++i) {
+            crc = static_cast<uint32_t>(crc32_combine(crc, crcs[i], static_cast<z_off_t>(piece(i + 1) - piece(i))));
+        }
+
+        return true;
+    }
+
+    // Add access points to index on several threads until one is within a span of until or the stream
+    // ends. Each round cuts the data after the last point into a chunk per thread, about a span of output
+    // each, decodes them without their windows and resolves only the last 32 KB of each in order, so
+    // chunks may keep their markers and memory stays around 2 bytes a byte of a round. False when a
+    // round could not be split or decoded, the points of the rounds before stay.
+    static bool index(const uint8_t * src, size_t src_size, uint64_t dst_size, zip_access_index & index, uint64_t until, unsigned threads) {
+        threads = zip_parallel::concurrency(threads); if(threads < 2 || !src_size) {
+            return false;
+        }
+
+        // Resume at the last point, its window is the one of the first chunk
+        uint64_t begin = 0, out = 0; std::vector<uint8_t> window; if(!index.points.empty()) {
+            auto & p = index.points.back(); begin = p.in * 8 - p.bits; out = p.out; window = p.window;
+        }
+
+        uint64_t step = std::max<uint64_t>(MIN_CHUNK, index.span * src_size / std::max<uint64_t>(dst_size, 1)) * 8, end = uint64_t(src_size) * 8;
+
+        double ratio = static_cast<double>(dst_size) / static_cast<double>(src_size);
+
+        while(!index.complete && out + index.span <= until) {
+            // Block starts after cuts a step apart, UINT64_MAX for cuts past the data and NONE for those
+            // without a block start soon after them, which are left out
+            static constexpr uint64_t NONE = UINT64_MAX - 1;
+
+            std::vector<uint64_t> starts(threads + 1, begin); zip_parallel::for_range(threads, threads, [&](size_t first, size_t last) {
+                for(size_t i = first + 1; i < last + 1; ++i) {
+                    uint64_t cut = begin + step * i; starts[i] = cut >= end ? UINT64_MAX : find_block(src, src_size, cut, std::min(cut + SEARCH_LIMIT * 8, end));
+
+                    if(starts[i] == UINT64_MAX && cut < end) starts[i] = NONE;
+                }
+            });
+
+            starts.erase(std::remove(starts.begin() + 1, starts.end(), NONE), starts.end());
+
+            // The last start ends the round and begins the next, one past the data ends the round with the stream
+            std::vector<chunk_t> chunks; for(size_t i = 0; i + 1 < starts.size() && starts[i] != UINT64_MAX; ++i) {
+                chunk_t c; c.begin = starts[i]; c.end = starts[i + 1]; chunks.push_back(std::move(c));
+            }
+
+            if(chunks.empty()) return false;
+
+            uint64_t stop = chunks.back().end;
+
+            std::atomic<bool> failed {false}; zip_parallel::for_range(chunks.size(), threads, [&](size_t first, size_t last) {
+                for(size_t i = first; i < last; ++i) {
+                    auto & c = chunks[i]; size_t expected = static_cast<size_t>(static_cast<double>(std::min(c.end, end) - c.begin) / 8 * ratio);
+
+                    if(!decode(c, src, src_size, c.begin == 0, expected, failed, 2 * expected + WINDOW_SIZE) && !c.deferred) failed = true;
+                }
+            });
+
+            if(failed) return false;
+
+            // In order, each chunk's window is the end of the output before it, its end a point
+            std::vector<zip_access_index::point_t> points; for(auto & c : chunks) {
+                if(!(c.deferred ? decode_window(c, src, src_size, window) : slide(window, c))) return false;
+
+                out += c.size; std::vector<uint16_t>().swap(c.head); std::vector<uint8_t>().swap(c.tail);
+
+                if(c.end != UINT64_MAX) {
+                    points.push_back({(c.end + 7) / 8, out, static_cast<uint8_t>((8 - (c.end & 7)) & 7), window});
+                }
+            }
+
+            if(stop == UINT64_MAX && out != dst_size) return false;
+
+            for(auto & p : points) index.points.push_back(std::move(p));
+
+            index.complete = stop == UINT64_MAX; begin = stop;
+        }
+
+        return true;
+    }
+};
+
+#ifdef ZIP_WITH_ZSTD
+// Decoding of Zstandard entries, which may hold several frames
+// Whole entries are decoded frame by frame on several threads when the frames are known, either
+// from a seek table in zstd's seekable format or from frame headers that record content sizes.
+struct zip_zstd {
+    static constexpr uint32_t SKIPPABLE_MAGIC = 0x184D2A50; // The low 4 bits are free
+    static constexpr uint32_t SEEK_TABLE_MAGIC = 0x184D2A5E;
+    static constexpr uint32_t SEEKABLE_MAGIC = 0x8F92EAB1;
+
+    // Smaller decodes run on the calling thread, a block read by zipfs still splits over small frames
+    static constexpr size_t PARALLEL_THRESHOLD = 1 << 20;
+
+    // Start of a frame in the compressed and in the decompressed data
+    struct frame_t {
+        uint64_t in;
+        uint64_t out;
+    };
+
+    struct dctx_free {
+        void operator()(ZSTD_DCtx * dctx) const { ZSTD_freeDCtx(dctx); }
+    };
+
+    using dctx_ptr = std::unique_ptr<ZSTD_DCtx, dctx_free>;
+
+    static uint32_t read32(const uint8_t * p) {
+        uint32_t v; memcpy(&v, p, 4); return v;
+    }
+
+    // Decompression context of the calling thread
+    static ZSTD_DCtx * local() {
+        thread_local dctx_ptr dctx {ZSTD_createDCtx()}; return dctx.get();
+    }
+
+    // Frames listed by the seek table at the end of the data, closed by a sentinel
+    static bool seek_table(const uint8_t * src, size_t size, std::vector<frame_t> & frames) {
+        frames.clear(); if(size < 17 || read32(src + size - 4) != SEEKABLE_MAGIC) {
+            return false;
+        }
+
+        // Footer: frame count, descriptor (bit 7 adds a checksum to each entry) and magic
+        uint64_t count = read32(src + size - 9); uint8_t descriptor = src[size - 5]; if(descriptor & 0x7C) {
+            return false;
+        }
+
+        uint64_t entry_size = (descriptor & 0x80) ? 12 : 8, table_size = 8 + count * entry_size + 9;
+
+        if(table_size > size) return false;
+
+        const uint8_t * table = src + size - table_size; if(read32(table) != SEEK_TABLE_MAGIC || read32(table + 4) != table_size - 8) {
+            return false;
+        }
+
+        uint64_t in = 0, out = 0; frames.reserve(count + 1); for(uint64_t i = 0; i < count; ++i) {
+            frames.push_back({in, out}); in += read32(table + 8 + i * entry_size); out += read32(table + 12 + i * entry_size);
+        }
+
+        if(in != size - table_size) {
+            frames.clear(); return false;
+        }
+
+        frames.push_back({in, out}); return true;
+    }
+
+    // Frames found by walking their headers, each one must record its content size
+    static bool walk_frames(const uint8_t * src, size_t size, std::vector<frame_t> & frames) {
+        frames.clear(); uint64_t in = 0, out = 0; while(in < size) {
+            if(size - in < 8) return false;
+
+            if((read32(src + in) & 0xFFFFFFF0) == SKIPPABLE_MAGIC) {
+                in += 8 + static_cast<uint64_t>(read32(src + in + 4)); continue;
+            }
+
+            size_t n = ZSTD_findFrameCompressedSize(src + in, size - in); if(ZSTD_isError(n)) {
+                return false;
+            }
+
+            unsigned long long content_size = ZSTD_getFrameContentSize(src + in, size - in); if(content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR) {
+                return false;
+            }
+
+            frames.push_back({in, out}); in += n; out += content_size;
+        }
+
+        if(in != size) return false;
+
+        frames.push_back({in, out}); return true;
+    }
+
+    // Decode frames first to last on all cores, dst holds the output from the start of the first one
+    static bool decode_frames(const uint8_t * src, std::vector<frame_t> const & frames, size_t first, size_t last, uint8_t * dst) {
+        // Frames are independent, each one decodes into its own part of the output
+        std::vector<uint8_t> ok(last - first); zip_parallel::for_range(last - first, 0, [&](size_t begin, size_t end) {
+            ZSTD_DCtx * dctx = local(); if(!dctx) {
+                return;
+            }
+
+            for(size_t i = first + begin; i < first + end; ++i) {
+                size_t expected = static_cast<size_t>(frames[i + 1].out - frames[i].out);
+
+                size_t n = ZSTD_decompressDCtx(dctx, dst + (frames[i].out - frames[first].out), expected, src + frames[i].in, static_cast<size_t>(frames[i + 1].in - frames[i].in));
+
+                ok[i - first] = !ZSTD_isError(n) && n == expected;
+            }
+        });
+
+        return std::all_of(ok.begin(), ok.end(), [](uint8_t x) { return x != 0; });
+    }
+
+    static bool one_shot(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+        std::vector<frame_t> frames; if(dst_size >= PARALLEL_THRESHOLD &&
+            (seek_table(src, src_size, frames) || walk_frames(src, src_size, frames)) && frames.size() > 2 && frames.back().out == dst_size) {
+            return decode_frames(src, frames, 0, frames.size() - 1, dst);
+        }
+
+        ZSTD_DCtx * dctx = local(); if(!dctx) {
+            return false;
+        }
+
+        size_t n = ZSTD_decompressDCtx(dctx, dst, dst_size, src, src_size); return !ZSTD_isError(n) && n == dst_size;
+    }
+
+    // Decompress only the first dst_size bytes, no more than the data holds
+    static bool prefix(const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+        ZSTD_DCtx * dctx = local(); if(!dctx || ZSTD_isError(ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only))) {
+            return false;
+        }
+
+        ZSTD_inBuffer in {src, src_size, 0}; ZSTD_outBuffer out {dst, dst_size, 0};
+
+        // Frames and skippable frames follow each other, stop when no progress is made
+        while(out.pos < out.size) {
+            size_t in_pos = in.pos, out_pos = out.pos;
+
+            if(ZSTD_isError(ZSTD_decompressStream(dctx, &out, &in))) return false;
+
+            if(in.pos == in_pos && out.pos == out_pos) break;
+        }
+
+        return out.pos == dst_size;
+    }
+};
+#endif
+
+// General purpose bit flags
+struct zip_gp_flags {
+    uint16_t raw_flags;
+
+    bool is_encrypted() const { return (raw_flags & 0x0001) != 0; }
+    bool has_data_descriptor() const { return (raw_flags & 0x0008) != 0; }
+    bool is_compressed_patched() const { return (raw_flags & 0x0020) != 0; }
+    bool is_strongly_encrypted() const { return (raw_flags & 0x0040) != 0; }
+    bool uses_utf8() const { return (raw_flags & 0x0800) != 0; }
+};
+
+// Packed structures for direct casting from ZIP file data
+#pragma pack(push, 1)
+// Local file header structure (packed for direct casting)
+struct zip_file_header {
+    uint16_t version;
+    uint16_t raw_flags;
+    uint16_t compression;
+    uint32_t dos_time;
+    uint32_t crc32;
+    uint32_t compressed_size;
+    uint32_t uncompressed_size;
+    uint16_t filename_length;
+    uint16_t extra_field_length;
+    // Marker for the start of variable-length data
+    // The actual filename follows this header in the ZIP file
+    char file_name[0];
+};
+
+// Central directory entry structure (packed for direct casting)
+struct zip_dir_entry {
+    uint16_t version_made_by;
+    uint16_t version_needed;
+    uint16_t raw_flags;
+    uint16_t compression;
+    uint32_t dos_time;
+    uint32_t crc32;
+    uint32_t compressed_size;
+    uint32_t uncompressed_size;
+    uint16_t filename_length;
+    uint16_t extra_field_length;
+    uint16_t comment_length;
+    uint16_t disk_number_start;
+    uint16_t internal_file_attributes;
+    uint32_t external_file_attributes;
+    uint32_t local_header_offset;
+    // Marker for the start of variable-length data
+    // The actual filename follows this header in the ZIP file
+    char file_name[0];
+};
+
+// End of central directory record structure (packed for direct casting)
+struct zip_end_of_central_dir {
+    uint16_t disk_number;
+    uint16_t central_dir_disk_number;
+    uint16_t num_entries_on_disk;
+    uint16_t num_entries_total;
+    uint32_t central_dir_size;
+    uint32_t central_dir_offset;
+    uint16_t comment_length;
+};
+
+// ZIP64 end of central directory locator structure (packed for direct casting)
+struct zip64_end_of_central_dir_locator {
+    uint32_t disk_number_with_zip64_end;
+    uint64_t relative_offset_of_zip64_end;
+    uint32_t total_number_of_disks;
+};
+
+// ZIP64 end of central directory record structure (packed for direct casting)
+struct zip64_end_of_central_dir {
+    uint64_t size_of_record;
+    uint16_t version_made_by;
+    uint16_t version_needed;
+    uint32_t disk_number;
+    uint32_t central_dir_disk_number;
+    uint64_t num_entries_on_disk;
+    uint64_t num_entries_total;
+    uint64_t central_dir_size;
+    uint64_t central_dir_offset;
+};
+
+// File info structure for retrieving information about files in the archive
+#pragma pack(pop)
+
+// Entry metadata served from the central directory alone, never touches the local file header
+struct zip_file_stat {
+    // Direct reference to the filename in the original data
+    std::string_view filename;
+
+    bool is_directory {false};
+
+    size_t compressed_size {0};
+    size_t uncompressed_size {0};
+
+    // Modification time (DOS format time)
+    uint32_t mod_time {0};
+
+    // Compression method
+    zip_compression_method compression {zip_compression_method::NONE};
+
+    // CRC-32 of the uncompressed data as recorded in the central directory
+    uint32_t crc {0};
+};
+
+// File info structure for retrieving information about files in the archive
+struct zip_file_info : zip_file_stat {
+    // Pointer to compressed data
+    const uint8_t * raw_ptr {nullptr};
+
+    // Additional pointer to data
+    const uint8_t * data_ptr {nullptr};
+
+    // Decompressed start of the data when only that was asked for, dropped once data() decodes it all
+    const uint8_t * head_ptr {nullptr};
+    size_t head_size {0};
+
+    // Whether the CRC-32 of the data was checked, and matched
+    bool crc_checked {false};
+    bool crc_ok {false};
+
+    // Default constructor
+    zip_file_info() = default;
+
+    // Disable copy constructor
+    zip_file_info(const zip_file_info &) = delete;
+
+    // Disable copy assignment
+    zip_file_info & operator=(const zip_file_info &) = delete;
+
+    // Move constructor
+    zip_file_info(zip_file_info && other) noexcept {
+        move_from(std::move(other));
+    }
+
+    // Move assignment
+    zip_file_info & operator=(zip_file_info && other) noexcept {
+        if(this != &other) {
+            free_resources();
+            move_from(std::move(other));
+        }
+        return *this;
+    }
+
+    // Destructor to free allocated memory
+    ~zip_file_info() {
+        free_resources();
+    }
+
+    // Helper method to free resources
+    void free_resources() {
+        // Only free data_ptr if it's not null and different from raw_ptr
+        if(data_ptr != nullptr && data_ptr != raw_ptr) {
+            zip_memory::release(const_cast<uint8_t *>(data_ptr));
+            data_ptr = nullptr;
+        }
+
+        release_head();
+    }
+
+    void release_head() {
+        if(head_ptr) zip_memory::release(const_cast<uint8_t *>(head_ptr));
+
+        head_ptr = nullptr; head_size = 0;
+    }
+
+    // Helper method to move resources from another instance
+    void move_from(zip_file_info && other) {
+        static_cast<zip_file_stat &>(*this) = other;
+        raw_ptr = other.raw_ptr;
+        data_ptr = other.data_ptr;
+        head_ptr = other.head_ptr;
+        head_size = other.head_size;
+        crc_checked = other.crc_checked;
+        crc_ok = other.crc_ok;
+
+        // Reset other's pointers
+        other.raw_ptr = nullptr;
+        other.data_ptr = nullptr;
+        other.head_ptr = nullptr;
+        other.head_size = 0;
+    }
+
+    // Returns decompressed data or raw data if no compression
+    uint8_t * data() {
+        // If data_ptr is already set, return it
+        if(data_ptr) {
+            return const_cast<uint8_t *>(data_ptr);
+        }
+
+        // If no raw data or this is a directory, return nullptr
+        if(!raw_ptr || is_directory) {
+            return nullptr;
+        }
+
+        // If no compression, just set data_ptr to raw_ptr and return it
+        if(compression == zip_compression_method::NONE) {
+            data_ptr = raw_ptr;
+            return const_cast<uint8_t *>(data_ptr);
+        }
+
+        // Unsupported compression method
+        if(!decoder()) return nullptr;
+
+        // Allocate memory for decompressed data
+        uint8_t * decompressed = static_cast<uint8_t *>(zip_memory::allocate(std::max<size_t>(uncompressed_size, 1))); if(!decompressed) {
+            return nullptr;
+        }
+
+        // Decompress
+        if(!decompress_into(decompressed, uncompressed_size)) {
+            // Decompression failed
+            zip_memory::release(decompressed);
+            return nullptr;
+        }
+
+        // Store the decompressed data pointer, the head is part of it now
+        data_ptr = decompressed; release_head();
+        return const_cast<uint8_t *>(data_ptr);
+    }
+
+    // Decompress the whole data into dst of at least uncompressed_size bytes, checked as data() checks it
+    bool decompress_into(uint8_t * dst, size_t dst_size) {
+        if(!raw_ptr || is_directory || dst_size < uncompressed_size) {
+            return false;
+        }
+
+        if(compression == zip_compression_method::NONE) {
+            memcpy(dst, raw_ptr, uncompressed_size); return true;
+        }
+
+        auto decode = decoder(); if(!decode) {
+            return false;
+        }
+
+        // Large deflated entries are tried on all cores first, trusted only if the CRC matches
+        bool done = false; if(compression == zip_compression_method::DEFLATED && uncompressed_size >= zip_pinflate::threshold() && zip_parallel::concurrency(0) > 1) {
+            uint32_t actual = 0; done = crc_checked = crc_ok = zip_pinflate::one_shot(raw_ptr, compressed_size, dst, uncompressed_size, 0, actual) && actual == crc;
+        }
+
+        if(!done && !decode(raw_ptr, compressed_size, dst, uncompressed_size)) {
+            return false;
+        }
+
+        // Check the data while it is hot in cache unless that is left to verify()
+        if(!crc_checked && zip_crc32::verify() == zip_verify::FULL) {
+            crc_checked = true; crc_ok = zip_crc32::update(0, dst, uncompressed_size) == crc;
+        }
+
+        return !crc_checked || crc_ok;
+    }
+
+    // Decompress only the first length bytes of the data into dst, a prefix is not checked against the CRC
+    bool prefix_into(uint8_t * dst, size_t length) {
+        if(!raw_ptr || is_directory || length > uncompressed_size) {
+            return false;
+        }
+
+        if(length == uncompressed_size) return decompress_into(dst, length);
+
+        if(compression == zip_compression_method::NONE) {
+            memcpy(dst, raw_ptr, length); return true;
+        }
+
+        auto decode = prefix_decoder(); return decode && decode(raw_ptr, compressed_size, dst, length);
+    }
+
+    // Check the CRC-32 of the whole data once, decompressing it if needed, false on a mismatch
+    bool verify() {
+        if(!crc_checked) {
+            const uint8_t * p = data(); if(!p) return false;
+
+            // data() may have checked it already
+            if(!crc_checked) {
+                crc_checked = true; crc_ok = zip_crc32::update(0, p, uncompressed_size) == crc;
+            }
+        }
+
+        return crc_ok;
+    }
+
+    // Returns at least the first length bytes of the data, decompressing only those unless all of
+    // it is asked for or already there. Valid up to head_size, or the whole size once data_ptr is set.
+    const uint8_t * head(size_t length) {
+        if(data_ptr || length >= uncompressed_size || compression == zip_compression_method::NONE) {
+            return data();
+        }
+
+        if(head_ptr && head_size >= length) return head_ptr;
+
+        if(!raw_ptr || is_directory || !prefix_decoder()) return nullptr;
+
+        // A head that keeps growing is decoded again at least twice as long, each time from the start
+        length = std::max({length, 2 * head_size, size_t(1)}); if(length >= uncompressed_size) {
+            return data();
+        }
+
+        uint8_t * decompressed = static_cast<uint8_t *>(zip_memory::allocate(length)); if(!decompressed) {
+            return nullptr;
+        }
+
+        if(!prefix_into(decompressed, length)) {
+            zip_memory::release(decompressed); return nullptr;
+        }
+
+        release_head(); head_ptr = decompressed; head_size = length;
+
+        return head_ptr;
+    }
+
+private:
+    typedef bool (*decode_fn)(const uint8_t *, size_t, uint8_t *, size_t);
+
+    // Whole-entry decoder of the compression method, nullptr when unsupported
+    decode_fn decoder() const {
+        if(compression == zip_compression_method::DEFLATED) {
+            return [](const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) { return zip_inflate::one_shot(src, src_size, dst, dst_size); };
+        }
+#ifdef ZIP_WITH_ZSTD
+        if(compression == zip_compression_method::ZSTANDARD) {
+            return zip_zstd::one_shot;
+        }
+#endif
+        return nullptr;
+    }
+
+    // Decoder of the first bytes of the data, nullptr when unsupported
+    decode_fn prefix_decoder() const {
+        if(compression == zip_compression_method::DEFLATED) {
+            return zip_inflate::prefix;
+        }
+#ifdef ZIP_WITH_ZSTD
+        if(compression == zip_compression_method::ZSTANDARD) {
+            return zip_zstd::prefix;
+        }
+#endif
+        return nullptr;
+    }
+};
+
+// Reads a window of an entry without decompressing the whole of it
+// The inflate cursor is kept between reads, so sequential reads continue where the previous one
+// stopped. Memory is bounded by the zlib state and a small buffer used to skip forward.
+struct zip_stream : zip_file_stat {
+    static constexpr size_t SKIP_BUFFER_SIZE = 64 * 1024;
+
+    // zlib limits a single call to 32 bit counts
+    static constexpr size_t MAX_CHUNK = 1u << 30;
+
+    // Pointer to compressed data
+    const uint8_t * raw_ptr {nullptr};
+
+    // Access points to restart from and to collect into, optional and owned by the caller
+    zip_access_index * access_index {nullptr};
+
+    zip_stream() = default;
+
+    // Read up to length bytes at offset, returns the number of bytes read or -1 on corrupt data
+    // Reading at or past the end returns 0. Reading before the cursor restarts the entry, from the
+    // closest access point (deflate) or seekable frame (zstd) when there is one, which is also taken
+    // to jump ahead.
+    ptrdiff_t read(uint64_t offset, uint8_t * buffer, size_t length) {
+        if(!raw_ptr || is_directory) return -1;
+
+        if(offset >= uncompressed_size) return 0;
+
+        length = static_cast<size_t>(std::min<uint64_t>(length, uncompressed_size - offset));
+
+        // Stored data is read in place
+        if(compression == zip_compression_method::NONE) {
+            memcpy(buffer, raw_ptr + offset, length); return static_cast<ptrdiff_t>(length);
+        }
+
+        if(!seek(offset)) return -1;
+
+#ifdef ZIP_WITH_ZSTD
+        if(compression == zip_compression_method::ZSTANDARD && length >= zip_zstd::PARALLEL_THRESHOLD && zip_parallel::concurrency(0) > 1) {
+            return read_frames(offset, buffer, length);
+        }
+#endif
+
+        return produce(buffer, length);
+    }
+
+    // Offset of the next byte the cursor produces
+    uint64_t position() const { return m_out; }
+
+private:
+    struct inflate_end {
+        void operator()(z_stream * strm) const { inflateEnd(strm); delete strm; }
+    };
+
+    // The z_stream lives on the heap as zlib keeps a pointer back to it
+    std::unique_ptr<z_stream, inflate_end> m_strm;
+
+    // Compressed bytes handed to zlib and bytes produced so far
+    uint64_t m_in {0}, m_out {0};
+
+    bool m_finished {false};
+
+    // The parallel index pass failed on this entry
+    bool m_unsplit {false};
+
+    std::vector<uint8_t> m_skip;
+
+    // CRC-32 of the output from the start up to m_crc_end
+    uint32_t m_crc {0};
+    uint64_t m_crc_end {0};
+
+#ifdef ZIP_WITH_ZSTD
+    zip_zstd::dctx_ptr m_zstd;
+
+    // Frames of a seekable entry, empty without a seek table
+    std::vector<zip_zstd::frame_t> m_frames;
+#endif
+
+    // Move the cursor to offset, restarting the entry if needed and skipping forward
+    bool seek(uint64_t offset) {
+        if(compression == zip_compression_method::DEFLATED) {
+            auto point = access_index ? access_index->find(offset) : nullptr;
+
+            // A long skip past the access points adds points on all cores first, once the data could not be
+            // split it is inflated on this one
+            if(access_index && !access_index->complete && !m_unsplit && zip_parallel::concurrency(0) > 1) {
+                uint64_t from = std::max<uint64_t>(point ? point->out : 0, m_strm && m_out <= offset ? m_out : 0);
+
+                if(offset - from >= zip_pinflate::threshold()) {
+                    m_unsplit = !zip_pinflate::index(raw_ptr, static_cast<size_t>(compressed_size), uncompressed_size, *access_index, offset, 0);
+
+                    point = access_index->find(offset);
+                }
+            }
+
+            if(!m_strm || offset < m_out || (point && point->out > m_out)) {
+                if(!(point ? restore(*point) : rewind())) return false;
+            }
+        }
+#ifdef ZIP_WITH_ZSTD
+        else if(compression == zip_compression_method::ZSTANDARD) {
+            if(!seek_frame(offset)) return false;
+        }
+#endif
+        else {
+            return false;
+        }
+
+        if(m_out < offset) {
+            m_skip.resize(SKIP_BUFFER_SIZE); while(m_out < offset) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(offset - m_out, m_skip.size()));
+
+                if(produce(m_skip.data(), n) <= 0) return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Decompress up to length bytes at the cursor, returns the number of bytes produced or -1 on corrupt data
+    // The CRC-32 is folded over output that continues it from the start, a mismatch fails the read reaching the end.
+    ptrdiff_t produce(uint8_t * out, size_t length) {
+        uint64_t start = m_out;
+
+#ifdef ZIP_WITH_ZSTD
+        ptrdiff_t n = compression == zip_compression_method::ZSTANDARD ? decompress_into(out, length) : inflate_into(out, length);
+#else
+        ptrdiff_t n = inflate_into(out, length);
+#endif
+
+        if(n <= 0) return n;
+
+        return fold(start, out, static_cast<size_t>(n)) ? n : -1;
+    }
+
+    // Fold the output at start into the CRC-32 when it continues it, false on a mismatch at the end
+    bool fold(uint64_t start, const uint8_t * out, size_t n) {
+        if(zip_crc32::verify() == zip_verify::NONE) return true;
+
+        // A restart at the beginning starts over, one at an access point leaves the CRC behind
+        if(start == 0) {
+            m_crc = 0; m_crc_end = 0;
+        }
+
+        if(start == m_crc_end) {
+            m_crc = zip_crc32::update(m_crc, out, n); m_crc_end += n;
+
+            if(m_crc_end == uncompressed_size && m_crc != crc) return false;
+        }
+
+        return true;
+    }
+
+#ifdef ZIP_WITH_ZSTD
+    // Restart at the frame holding offset when seeking backwards or past the current frame
+    bool seek_frame(uint64_t offset) {
+        // Only a seek table is read, walking the frame headers would touch the whole entry
+        if(!m_zstd) {
+            m_zstd.reset(ZSTD_createDCtx()); if(!m_zstd) return false;
+
+            zip_zstd::seek_table(raw_ptr, compressed_size, m_frames);
+        }
+
+        const zip_zstd::frame_t * frame = nullptr; if(m_frames.size() > 1) {
+            auto it = std::upper_bound(m_frames.begin(), m_frames.end() - 1, offset, [](uint64_t o, zip_zstd::frame_t const & f) { return o < f.out; });
+
+            frame = &*(it - 1);
+        }
+
+        if(offset < m_out || (frame && frame->out > m_out)) {
+            if(ZSTD_isError(ZSTD_DCtx_reset(m_zstd.get(), ZSTD_reset_session_only))) return false;
+
+            m_in = frame ? frame->in : 0; m_out = frame ? frame->out : 0;
+        }
+
+        return true;
+    }
+
+    // A read over two or more whole frames decodes them on all cores, the parts before and after go
+    // through the cursor, which is left at the end of the read
+    ptrdiff_t read_frames(uint64_t offset, uint8_t * buffer, size_t length) {
+        uint64_t end = offset + length; auto out_before = [](zip_zstd::frame_t const & f, uint64_t o) { return f.out < o; };
+
+        // Frames first to last lie within the read, m_frames closes with the end of the data
+        size_t first = std::lower_bound(m_frames.begin(), m_frames.end(), offset, out_before) - m_frames.begin();
+        size_t last = std::lower_bound(m_frames.begin(), m_frames.end(), end + 1, out_before) - m_frames.begin() - 1;
+
+        if(m_frames.size() < 3 || first == m_frames.size() || last < first + 2) {
+            return produce(buffer, length);
+        }
+
+        size_t head = static_cast<size_t>(m_frames[first].out - offset), size = static_cast<size_t>(m_frames[last].out - m_frames[first].out);
+
+        if(head) {
+            ptrdiff_t n = produce(buffer, head); if(n != static_cast<ptrdiff_t>(head)) return n;
+        }
+
+        if(!zip_zstd::decode_frames(raw_ptr, m_frames, first, last, buffer + head) || !fold(m_frames[first].out, buffer + head, size)) {
+            return -1;
+        }
+
+        if(ZSTD_isError(ZSTD_DCtx_reset(m_zstd.get(), ZSTD_reset_session_only))) return -1;
+
+        m_in = m_frames[last].in; m_out = m_frames[last].out; if(m_out == end) {
+            return static_cast<ptrdiff_t>(length);
+        }
+
+        ptrdiff_t n = produce(buffer + head + size, static_cast<size_t>(end - m_out)); return n < 0 ? -1 : static_cast<ptrdiff_t>(head + size) + n;
+    }
+
+    ptrdiff_t decompress_into(uint8_t * out, size_t length) {
+        ZSTD_inBuffer in {raw_ptr, static_cast<size_t>(compressed_size), static_cast<size_t>(m_in)};
+        ZSTD_outBuffer output {out, length, 0};
+
+        // Frames and skippable frames follow each other, stop when no progress is made
+        while(output.pos < output.size) {
+            size_t in_pos = in.pos, out_pos = output.pos;
+
+            if(ZSTD_isError(ZSTD_decompressStream(m_zstd.get(), &output, &in))) return -1;
+
+            if(in.pos == in_pos && output.pos == out_pos) break;
+        }
+
+        m_in = in.pos; m_out += output.pos; return static_cast<ptrdiff_t>(output.pos);
+    }
+#endif
+
+    bool reset() {
+        if(m_strm) {
+            if(inflateReset(m_strm.get()) != Z_OK) return false;
+        } else {
+            auto strm = new z_stream {}; zip_memory::setup(*strm); if(inflateInit2(strm, -MAX_WBITS) != Z_OK) {
+                delete strm; return false;
+            }
+
+            m_strm.reset(strm);
+        }
+
+        m_strm->avail_in = 0; m_finished = false; return true;
+    }
+
+    // Restart decompression at the beginning of the entry
+    bool rewind() {
+        if(!reset()) return false;
+
+        m_in = m_out = 0; return true;
+    }
+
+    // Restart decompression at an access point
+    bool restore(zip_access_index::point_t const & point) {
+        if(!reset()) return false;
+
+        // The block starts within the byte before point.in
+        if(point.bits) {
+            if(inflatePrime(m_strm.get(), point.bits, raw_ptr[point.in - 1] >> (8 - point.bits)) != Z_OK) return false;
+        }
+
+        if(inflateSetDictionary(m_strm.get(), point.window.data(), static_cast<uInt>(point.window.size())) != Z_OK) return false;
+
+        m_in = point.in; m_out = point.out; return true;
+    }
+
+    // Output offset from which the next access point is recorded
+    uint64_t next_point() const {
+        auto & points = access_index->points; return (points.empty() ? 0 : points.back().out) + access_index->span;
+    }
+
+    // Record an access point at a block boundary when the last one is a span behind
+    void add_point(uint64_t out) {
+        if(out < next_point()) return;
+
+        zip_access_index::point_t point {m_in - m_strm->avail_in, out, static_cast<uint8_t>(m_strm->data_type & 7), {}}; {
+            uInt length = zip_access_index::WINDOW_SIZE; point.window.resize(length);
+
+            inflateGetDictionary(m_strm.get(), point.window.data(), &length); point.window.resize(length);
+        }
+
+        access_index->points.push_back(std::move(point));
+    }
+
+    // Inflate up to length bytes, returns the number of bytes produced or -1 on corrupt data
+    ptrdiff_t inflate_into(uint8_t * out, size_t length) {
+        size_t produced = 0; while(produced < length && !m_finished) {
+            // All input may be consumed while output is still pending, zlib reports a stall as Z_BUF_ERROR
+            if(m_strm->avail_in == 0) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(compressed_size - m_in, MAX_CHUNK));
+
+                m_strm->next_in = const_cast<Bytef *>(raw_ptr + m_in); m_strm->avail_in = static_cast<uInt>(n); m_in += n;
+            }
+
+            uInt avail = static_cast<uInt>(std::min(length - produced, MAX_CHUNK)); {
+                m_strm->next_out = out + produced; m_strm->avail_out = avail;
+            }
+
+            // Stop at block boundaries once this read may reach the next access point
+            bool collect = access_index && !access_index->complete && m_out + length >= next_point();
+
+            int ret = inflate(m_strm.get(), collect ? Z_BLOCK : Z_NO_FLUSH); produced += avail - m_strm->avail_out;
+
+            if(ret == Z_STREAM_END) {
+                m_finished = true;
+            } else if(ret != Z_OK) {
+                return -1;
+            } else if(collect && (m_strm->data_type & 128) && !(m_strm->data_type & 64)) {
+                add_point(m_out + produced);
+            }
+        }
+
+        m_out += produced;
+
+        // Reads stop at the entry size, possibly before zlib saw the end of the stream
+        if(access_index && m_out >= uncompressed_size) access_index->complete = true;
+
+        return static_cast<ptrdiff_t>(produced);
+    }
+};
+
+// A column of the entry index, either owning its storage or viewing external memory
+template<typename T>
+struct zip_column {
+    std::vector<T> storage;
+    const T * ptr {nullptr};
+    size_t count {0};
+
+    zip_column() = default;
+
+    zip_column(const zip_column & other) { *this = other; }
+
+    zip_column(zip_column && other) noexcept { *this = std::move(other); }
+
+    zip_column & operator=(const zip_column & other) {
+        if(this != &other) {
+            storage = other.storage; count = other.count; ptr = storage.empty() ? other.ptr : storage.data();
+        }
+        return *this;
+    }
+
+    zip_column & operator=(zip_column && other) noexcept {
+        if(this != &other) {
+            storage = std::move(other.storage); ptr = other.ptr; count = other.count;
+            other.ptr = nullptr; other.count = 0;
+        }
+        return *this;
+    }
+
+    // Take ownership of the values
+    void assign(std::vector<T> && values) {
+        storage = std::move(values); ptr = storage.data(); count = storage.size();
+    }
+
+    // Refer to values owned by someone else
+    void view(const T * values, size_t n) {
+        storage = {}; ptr = values; count = n;
+    }
+
+    void clear() { storage = {}; ptr = nullptr; count = 0; }
+
+    const T & operator[](size_t i) const { return ptr[i]; }
+
+    const T * data() const { return ptr; }
+
+    size_t size() const { return count; }
+
+    size_t memory_usage() const { return storage.capacity() * sizeof(T); }
+};
+
+// Struct-of-arrays entry index in sorted name order, built once at open
+// Lookups are served from these dense columns instead of the central directory records.
+struct zip_entry_index {
+    enum { FLAG_DIRECTORY = 0x01 };
+
+    zip_column<uint64_t> uncompressed_size;
+    zip_column<uint64_t> compressed_size;
+    zip_column<uint64_t> local_header_offset;
+    zip_column<uint32_t> dos_time;
+    zip_column<uint32_t> crc32;
+    zip_column<uint32_t> name_offset; // Offset of the filename relative to the central directory
+    zip_column<uint16_t> name_length;
+    zip_column<uint16_t> method;
+    zip_column<uint8_t> flags;
+
+    // Open-addressing hash table over full names, linear probing with a power-of-two size
+    // Each slot holds the upper 32 bits of the name hash and the entry index + 1 (0 marks an empty slot),
+    // so a probe only touches the name when the inline hash matches.
+    zip_column<uint64_t> hash_slots;
+
+    // Directory tree, node 0 is the root
+    // Nodes are numbered breadth first, so the children of a node are contiguous and sorted by name.
+    // Directories without an entry of their own (implicit directories) have node_entry == NO_ENTRY.
+    static constexpr uint32_t NO_ENTRY = UINT32_MAX;
+
+    zip_column<uint32_t> node_entry;
+    zip_column<uint32_t> node_name_offset; // Offset of the last path component relative to the central directory
+    zip_column<uint16_t> node_name_length;
+    zip_column<uint32_t> node_first_child;
+    zip_column<uint32_t> node_child_count;
+    zip_column<uint8_t> node_flags;
+
+    size_t size() const { return name_offset.size(); }
+
+    size_t node_count() const { return node_entry.size(); }
+
+    // Call f(column) for every column, in the order they are persisted
+    template<typename F>
+    void for_each_column(F && f) {
+        f(uncompressed_size); f(compressed_size); f(local_header_offset); f(dos_time); f(crc32);
+        f(name_offset); f(name_length); f(method); f(flags); f(hash_slots);
+        f(node_entry); f(node_name_offset); f(node_name_length); f(node_first_child); f(node_child_count); f(node_flags);
+    }
+
+    template<typename F>
+    void for_each_column(F && f) const { const_cast<zip_entry_index *>(this)->for_each_column([&](auto const & column) { f(column); }); }
+
+    void clear() {
+        for_each_column([](auto & column) { column.clear(); });
+    }
+
+    size_t memory_usage() const {
+        size_t r = 0; for_each_column([&r](auto const & column) { r += column.memory_usage(); }); return r;
+    }
+
+    // 64-bit hash of a name, eight bytes per step
+    static uint64_t hash(const char * name, size_t len) {
+        const uint64_t m = 0x9E3779B97F4A7C15ull; uint64_t h = len * m;
+
+        while(len >= 8) {
+            uint64_t v; memcpy(&v, name, 8); h = (h ^ v) * m; h ^= h >> 29; name += 8; len -= 8;
+        }
+
+        if(len > 0) {
+            uint64_t v = 0; memcpy(&v, name, len); h = (h ^ v) * m; h ^= h >> 29;
+        }
+
+        // Final avalanche (murmur3 fmix64)
+        h ^= h >> 33; h *= 0xff51afd7ed558ccdull; h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ull; h ^= h >> 33;
+
+        return h;
+    }
+
+    // Build the hash table for names given by name(i) -> std::string_view
+    template<typename F>
+    void build_hash(size_t n, F && name) {
+        size_t capacity = 16; while(capacity < n * 2) capacity <<= 1;
+
+        std::vector<uint64_t> slots(capacity, 0); size_t mask = capacity - 1;
+
+        for(size_t i = 0; i < n; ++i) {
+            std::string_view s = name(i); uint64_t h = hash(s.data(), s.size());
+
+            size_t j = static_cast<size_t>(h) & mask; while(slots[j]) j = (j + 1) & mask;
+
+            slots[j] = (h & 0xFFFFFFFF00000000ull) | static_cast<uint64_t>(i + 1);
+        }
+
+        hash_slots.assign(std::move(slots));
+    }
+
+    // Find an entry by its full name, returns SIZE_MAX if not found
+    template<typename F>
+    size_t find_hash(const char * name, size_t len, F && entry_name) const {
+        if(hash_slots.size() == 0) return SIZE_MAX;
+
+        uint64_t h = hash(name, len), tag = h & 0xFFFFFFFF00000000ull; size_t mask = hash_slots.size() - 1;
+
+        for(size_t j = static_cast<size_t>(h) & mask;; j = (j + 1) & mask) {
+            uint64_t slot = hash_slots[j]; if(!slot) return SIZE_MAX;
+
+            if((slot & 0xFFFFFFFF00000000ull) == tag) {
+                size_t i = static_cast<size_t>(slot & 0xFFFFFFFF) - 1;
+
+                if(name_length[i] == len && memcmp(entry_name(i), name, len) == 0) return i;
+            }
+        }
+    }
+};
+
+// Header of a persisted entry index, see zip_archive::save_index()
+// The file is the header followed by the index columns, each 8-byte aligned, so a mapped file
+// is adopted in place. It is keyed by the archive size, its modification time and a hash of the
+// end of central directory records.
+struct zip_index_header {
+    static constexpr uint32_t MAGIC = 0x5844495A; // "ZIDX"
+    static constexpr uint32_t VERSION = 3;
+    static constexpr uint32_t MAX_COLUMNS = 32;
+
+    struct column_t {
+        uint64_t offset;
+        uint64_t count;
+        uint32_t element_size;
+        uint32_t reserved;
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size; // Size of the whole index file, a truncated write is rejected
+
+    uint64_t archive_size;
+    uint64_t archive_mtime;
+    uint64_t eocd_hash;
+
+    uint64_t zip_base_offset;
+    uint64_t central_dir_offset;
+    uint64_t central_dir_size;
+    uint64_t num_entries;
+    uint64_t zip64_eocd_pos;
+    uint32_t is_zip64;
+    uint32_t column_count;
+    uint32_t checksum; // CRC-32 of everything after the header
+    uint32_t reserved;
+
+    column_t columns[MAX_COLUMNS];
+};
+
+// Header of the persisted access points of an entry, see zip_archive::save_access_index()
+// Each point follows as a point_t record and its window. The file is keyed like the entry index
+// and by the position and sizes of the entry.
+struct zip_access_header {
+    static constexpr uint32_t MAGIC = 0x5354505A; // "ZPTS"
+    static constexpr uint32_t VERSION = 1;
+
+    struct point_t {
+        uint64_t in;
+        uint64_t out;
+        uint32_t bits;
+        uint32_t window_size;
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+
+    uint64_t archive_size;
+    uint64_t archive_mtime;
+    uint64_t eocd_hash;
+
+    uint64_t local_header_offset;
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+    uint64_t span;
+    uint64_t count;
+};
+
+struct zip_archive {
+    // Data members
+    uint8_t * m_data = nullptr;   // Pointer to the beginning of the buffer
+    size_t m_size = 0;            // Size of the entire buffer
+    size_t m_zip_base_offset = 0; // Offset to the beginning of the ZIP archive within the buffer
+    size_t m_zip_central_dir_offset = 0; // Offset to the central directory within the buffer
+
+    // Central directory information
+    const uint8_t * m_central_dir = nullptr; // Pointer to the central directory
+    size_t m_central_dir_size = 0;           // Size of the central directory in bytes
+    size_t m_num_entries = 0;                // Number of entries in the central directory
+    zip_entry_index m_index;                 // Entry index in sorted name order
+
+    // Key of the persisted index
+    uint64_t m_mtime = 0;     // Modification time of the archive as given by the caller
+    uint64_t m_eocd_hash = 0; // Hash of the end of central directory records
+
+    // Entry count from which the central directory is indexed with several threads
+    size_t m_parallel_threshold = 256 * 1024;
+    unsigned m_threads = 0; // 0 uses the hardware concurrency
+
+    // ZIP64 support
+    bool m_is_zip64 = false;                                 // Whether this is a ZIP64 archive
+    size_t m_zip64_eocd_pos = SIZE_MAX;                      // Position of the ZIP64 end of central directory record
+
+    zip_archive() = default;
+
+    zip_archive(const void * data, size_t size) { open((uint8_t *)data, size); }
+
+    zip_archive(std::string_view const & x) { open((uint8_t *)x.data(), x.size()); }
+
+    // Find the position of the end of central directory record
+    // Returns the position of the signature or SIZE_MAX if not found
+    static size_t find_end_of_central_dir(uint8_t * data, size_t size) {
+        // ZIP end of central directory signature is 'PK\x05\x06'
+        // It must be followed by a variable-length comment, so we need to search for it
+        // from the end of the file
+
+        // Minimum size of end of central directory record is 22 bytes
+        // 4 bytes signature + 18 bytes data + variable length comment
+        if(size < 22) return SIZE_MAX;
+
+        // Search for the signature from the end of the file
+        // The maximum size of the comment is 65535 bytes, so we don't need to search
+        // more than that distance from the end
+        size_t search_size = std::min(size, size_t(65557)); // 65535 + 22
+        size_t window = size - search_size;
+
+        // Candidates lie in [window, size - 22], a signature inside the comment is skipped
+        // when the record's comment would run past the end of the buffer
+        size_t n = search_size - 18; while(n >= 4) {
+            size_t pos = zip_scan::rfind(data + window, n, zip_constants::SIGNATURE_ZIP_END_OF_CENTRAL_DIR_RECORD); if(pos == SIZE_MAX) {
+                break;
+            }
+
+            const zip_end_of_central_dir * eocd_record = reinterpret_cast<const zip_end_of_central_dir *>(data + window + pos + 4);
+            if(window + pos + 22 + eocd_record->comment_length <= size) return window + pos;
+
+            n = pos + 3;
+        }
+
+        return SIZE_MAX;
+    }
+
+    // Find ZIP64 end of central directory locator
+    // Returns the position of the signature or SIZE_MAX if not found
+    static size_t find_zip64_end_of_central_dir_locator(uint8_t * data, size_t size, size_t eocd_pos) {
+        // ZIP64 end of central directory locator is 20 bytes and precedes the EOCD
+        if(eocd_pos < 20) return SIZE_MAX;
+
+        size_t locator_pos = eocd_pos - 20;
+
+        // Check for ZIP64 end of central directory locator signature
+        if(zip_scan::match(data + locator_pos, zip_constants::SIGNATURE_ZIP64_END_OF_CENTRAL_DIR_LOCATOR)) {
+            return locator_pos;
+        }
+
+        return SIZE_MAX;
+    }
+
+    // Find ZIP64 end of central directory record
     // Returns the position of the record or SIZE_MAX if not found
     static size_t find_zip64_end_of_central_dir(uint8_t * data, size_t size, uint64_t offset) {
         if(offset + 56 > size) return SIZE_MAX;
 
-        // Check for ZIP64 end of central directory signature
-        if(data[offset] == 'P' && data[offset + 1] == 'K' &&
-            data[offset + 2] == 0x06 && data[offset + 3] == 0x06) {
-            return offset;
+        // Check for ZIP64 end of central directory signature
+        if(data[offset] == 'P' && data[offset + 1] == 'K' &&
+            data[offset + 2] == 0x06 && data[offset + 3] == 0x06) {
+            return offset;
+        }
+
+        return SIZE_MAX;
+    }
+
+    static bool is_valid(uint8_t * data, size_t size) {
+        return find_end_of_central_dir(data, size) != SIZE_MAX;
+    }
+
+    void open(uint8_t * data, size_t size) { open(data, size, nullptr, 0, 0); }
+
+    // Open the archive, adopting a persisted index (see save_index) when its key matches
+    // The index columns then refer to index_data, which must outlive the archive.
+    // Returns true if the index was adopted, false if the central directory was parsed.
+    bool open(uint8_t * data, size_t size, const uint8_t * index_data, size_t index_size, uint64_t mtime) {
+        // Find the end of central directory record
+        size_t eocd_pos = find_end_of_central_dir(data, size); if(eocd_pos == SIZE_MAX) {
+            throw std::runtime_error("Not a valid ZIP file");
+        }
+
+        // Store the data pointer and size for later use
+        m_data = data; m_size = size; m_mtime = mtime;
+
+        // Parse the end of central directory record
+        // Cast the data to the packed structure
+        const zip_end_of_central_dir * eocd_record = reinterpret_cast<const zip_end_of_central_dir *>(m_data + eocd_pos + 4);
+
+        // Check for ZIP64 format
+        check_zip64_support(eocd_pos);
+
+        // The records at the tail identify the archive content cheaply
+        m_eocd_hash = zip_entry_index::hash(reinterpret_cast<const char *>(m_data) + (m_is_zip64 ? m_zip64_eocd_pos : eocd_pos),
+            m_size - (m_is_zip64 ? m_zip64_eocd_pos : eocd_pos));
+
+        if(index_data && adopt_index(index_data, index_size)) {
+            return true;
+        }
+
+        // Determine the base offset of the ZIP archive
+        if((m_zip_base_offset = find_zip_base_offset(eocd_pos, eocd_record)) == SIZE_MAX) {
+            throw std::runtime_error("Invalid ZIP file");
+        }
+
+        // Parse the central directory entries
+        parse_central_directory(eocd_record);
+
+        return false;
+    }
+
+    // Serialize the index for adoption by a later open() of the same archive
+    std::vector<uint8_t> save_index() const {
+        zip_index_header header {}; {
+            header.magic = zip_index_header::MAGIC;
+            header.version = zip_index_header::VERSION;
+            header.archive_size = m_size;
+            header.archive_mtime = m_mtime;
+            header.eocd_hash = m_eocd_hash;
+            header.zip_base_offset = m_zip_base_offset;
+            header.central_dir_offset = m_zip_central_dir_offset;
+            header.central_dir_size = m_central_dir_size;
+            header.num_entries = m_num_entries;
+            header.zip64_eocd_pos = m_zip64_eocd_pos;
+            header.is_zip64 = m_is_zip64;
+        }
+
+        // Lay out the columns after the header
+        size_t offset = sizeof(zip_index_header); m_index.for_each_column([&](auto const & column) {
+            auto & c = header.columns[header.column_count++]; {
+                c.offset = offset; c.count = column.size(); c.element_size = sizeof(column[0]);
+            }
+
+            offset = (offset + column.size() * sizeof(column[0]) + 7) & ~size_t(7);
+        });
+
+        header.file_size = offset;
+
+        std::vector<uint8_t> r(offset, 0); {
+            memcpy(r.data(), &header, sizeof(header));
+        }
+
+        size_t k = 0; m_index.for_each_column([&](auto const & column) {
+            if(column.size()) memcpy(r.data() + header.columns[k].offset, column.data(), column.size() * sizeof(column[0]));
+            ++k;
+        });
+
+        // The columns are used as offsets and indexes once adopted, a damaged file must not get that far
+        uint32_t checksum = zip_crc32::update(0, r.data() + sizeof(header), r.size() - sizeof(header));
+
+        memcpy(r.data() + offsetof(zip_index_header, checksum), &checksum, sizeof(checksum));
+
+        return r;
+    }
+
+    // Serialize the access points of an entry, only a complete set is worth keeping
+    std::vector<uint8_t> save_access_index(size_t index, zip_access_index const & access_index) const {
+        if(index >= m_num_entries || !access_index.complete) return {};
+
+        zip_access_header header {}; {
+            header.magic = zip_access_header::MAGIC;
+            header.version = zip_access_header::VERSION;
+            header.archive_size = m_size;
+            header.archive_mtime = m_mtime;
+            header.eocd_hash = m_eocd_hash;
+            header.local_header_offset = m_index.local_header_offset[index];
+            header.compressed_size = m_index.compressed_size[index];
+            header.uncompressed_size = m_index.uncompressed_size[index];
+            header.span = access_index.span;
+            header.count = access_index.points.size();
+        }
+
+        header.file_size = sizeof(header); for(auto & p : access_index.points) {
+            header.file_size += sizeof(zip_access_header::point_t) + p.window.size();
+        }
+
+        std::vector<uint8_t> r(header.file_size); uint8_t * out = r.data(); {
+            memcpy(out, &header, sizeof(header)); out += sizeof(header);
+        }
+
+        for(auto & p : access_index.points) {
+            zip_access_header::point_t record {p.in, p.out, p.bits, static_cast<uint32_t>(p.window.size())};
+
+            memcpy(out, &record, sizeof(record)); out += sizeof(record);
+            memcpy(out, p.window.data(), p.window.size()); out += p.window.size();
+        }
+
+        return r;
+    }
+
+    // Load persisted access points of an entry, after checking their key and bounds
+    bool load_access_index(size_t index, const uint8_t * data, size_t size, zip_access_index & access_index) const {
+        if(index >= m_num_entries || size < sizeof(zip_access_header)) return false;
+
+        zip_access_header header; memcpy(&header, data, sizeof(header));
+
+        if(header.magic != zip_access_header::MAGIC || header.version != zip_access_header::VERSION) return false;
+        if(header.file_size != size) return false;
+        if(header.archive_size != m_size || header.archive_mtime != m_mtime || header.eocd_hash != m_eocd_hash) return false;
+        if(header.local_header_offset != m_index.local_header_offset[index] || header.compressed_size != m_index.compressed_size[index] ||
+            header.uncompressed_size != m_index.uncompressed_size[index]) return false;
+
+        std::vector<zip_access_index::point_t> points; size_t pos = sizeof(header);
+
+        for(uint64_t k = 0; k < header.count; ++k) {
+            zip_access_header::point_t record; if(size - pos < sizeof(record)) return false;
+
+            memcpy(&record, data + pos, sizeof(record)); pos += sizeof(record);
+
+            // Points must be in order, within the entry and restartable
+            if(record.window_size > zip_access_index::WINDOW_SIZE || size - pos < record.window_size) return false;
+            if(record.bits > 7 || record.in == 0 || record.in > header.compressed_size || record.out > header.uncompressed_size) return false;
+            if(!points.empty() && record.out <= points.back().out) return false;
+
+            points.push_back({record.in, record.out, static_cast<uint8_t>(record.bits), std::vector<uint8_t>(data + pos, data + pos + record.window_size)});
+
+            pos += record.window_size;
+        }
+
+        if(pos != size) return false;
+
+        access_index.span = header.span; access_index.points = std::move(points); access_index.complete = true;
+
+        return true;
+    }
+
+    // Adopt a persisted index in place, after checking its key and layout
+    bool adopt_index(const uint8_t * index_data, size_t index_size) {
+        if(index_size < sizeof(zip_index_header) || (reinterpret_cast<uintptr_t>(index_data) & 7) != 0) return false;
+
+        const zip_index_header * header = reinterpret_cast<const zip_index_header *>(index_data);
+
+        if(header->magic != zip_index_header::MAGIC || header->version != zip_index_header::VERSION) return false;
+        if(header->file_size != index_size) return false;
+        if(header->archive_size != m_size || header->archive_mtime != m_mtime || header->eocd_hash != m_eocd_hash) return false;
+        if(header->central_dir_offset + header->central_dir_size > m_size) return false;
+        if(header->is_zip64 != static_cast<uint32_t>(m_is_zip64)) return false;
+        if(header->checksum != zip_crc32::update(0, index_data + sizeof(zip_index_header), index_size - sizeof(zip_index_header))) return false;
+
+        // Check the column layout before pointing into the file
+        bool ok = true; uint32_t k = 0; m_index.for_each_column([&](auto const & column) {
+            if(k >= header->column_count) { ok = false; return; }
+
+            auto const & c = header->columns[k++];
+            ok = ok && c.element_size == sizeof(column[0]) && (c.offset & 7) == 0 && c.offset <= index_size &&
+                c.count <= (index_size - c.offset) / c.element_size;
+        });
+
+        if(!ok || k != header->column_count) return false;
+
+        k = 0; m_index.for_each_column([&](auto & column) {
+            auto const & c = header->columns[k++];
+            column.view(reinterpret_cast<std::remove_cv_t<std::remove_reference_t<decltype(column[0])>> const *>(index_data + c.offset), static_cast<size_t>(c.count));
+        });
+
+        if(m_index.size() != header->num_entries || !check_index(static_cast<size_t>(header->central_dir_size))) {
+            m_index.clear(); return false;
         }
 
-        return SIZE_MAX;
-    }
+        m_zip_base_offset = static_cast<size_t>(header->zip_base_offset);
+        m_zip_central_dir_offset = static_cast<size_t>(header->central_dir_offset);
+        m_central_dir = m_data + m_zip_central_dir_offset;
+        m_central_dir_size = static_cast<size_t>(header->central_dir_size);
+        m_num_entries = static_cast<size_t>(header->num_entries);
 
-    static bool is_valid(uint8_t * data, size_t size) {
-        return find_end_of_central_dir(data, size) != SIZE_MAX;
+        return true;
     }
 
-    void open(uint8_t * data, size_t size) {
-        // Find the end of central directory record
-        size_t eocd_pos = find_end_of_central_dir(data, size); if(eocd_pos == SIZE_MAX) {
-            throw std::runtime_error("Not a valid ZIP file");
+    // Check that an adopted index only refers within itself, the central directory and the archive
+    bool check_index(size_t central_dir_size) const {
+        auto & x = m_index; size_t n = x.size(), nodes = x.node_count();
+
+        // Entry columns match the entry count, node columns the node count
+        if(x.uncompressed_size.size() != n || x.compressed_size.size() != n || x.local_header_offset.size() != n || x.dos_time.size() != n ||
+            x.crc32.size() != n || x.name_length.size() != n || x.method.size() != n || x.flags.size() != n) return false;
+
+        if(nodes == 0 || x.node_name_offset.size() != nodes || x.node_name_length.size() != nodes || x.node_first_child.size() != nodes ||
+            x.node_child_count.size() != nodes || x.node_flags.size() != nodes) return false;
+
+        // Names lie within the central directory, after the fixed part of their record, and data within the archive
+        for(size_t i = 0; i < n; ++i) {
+            if(x.name_offset[i] < 46 || uint64_t(x.name_offset[i]) + x.name_length[i] > central_dir_size) return false;
+            if(x.local_header_offset[i] >= m_size || x.compressed_size[i] > m_size) return false;
         }
 
-        // Store the data pointer and size for later use
-        m_data = data; m_size = size;
+        // Children are node ranges, entries of nodes are entry indexes
+        for(size_t i = 0; i < nodes; ++i) {
+            if(uint64_t(x.node_name_offset[i]) + x.node_name_length[i] > central_dir_size) return false;
+            if(uint64_t(x.node_first_child[i]) + x.node_child_count[i] > nodes) return false;
+            if(x.node_entry[i] != zip_entry_index::NO_ENTRY && x.node_entry[i] >= n) return false;
+        }
 
-        // Parse the end of central directory record
-        // Cast the data to the packed structure
-        const zip_end_of_central_dir * eocd_record = reinterpret_cast<const zip_end_of_central_dir *>(m_data + eocd_pos + 4);
+        // The hash table is a power of two in size, holds entry indexes + 1 and has an empty slot to end probes
+        size_t slots = x.hash_slots.size(), empty = 0; if(slots == 0 || (slots & (slots - 1)) != 0) return false;
 
-        // Check for ZIP64 format
-        check_zip64_support(eocd_pos);
+        for(size_t j = 0; j < slots; ++j) {
+            uint64_t slot = x.hash_slots[j]; if(!slot) { ++empty; continue; }
 
-        // Determine the base offset of the ZIP archive
-        if((m_zip_base_offset = find_zip_base_offset(eocd_record)) == SIZE_MAX) {
-            throw std::runtime_error("Invalid ZIP file");
+            if((slot & 0xFFFFFFFF) == 0 || (slot & 0xFFFFFFFF) > n) return false;
         }
 
-        // Parse the central directory entries
-        parse_central_directory(eocd_record);
+        return empty > 0;
     }
 
     // Get the number of files in the archive
@@ -393,9 +2536,12 @@ struct zip_archive {
     bool is_zip64() const { return m_is_zip64; }
 
     // Parse ZIP64 extended information from extra field
-    bool parse_zip64_extended_info(const uint8_t * extra_field, uint16_t extra_field_length,
+    // Per the specification the field only holds the values whose 32-bit counterparts in the
+    // header are saturated (0xFFFFFFFF), in the fixed order: uncompressed size, compressed size,
+    // local header offset. The caller passes in the 32-bit values and gets the 64-bit ones back.
+    static bool parse_zip64_extended_info(const uint8_t * extra_field, uint16_t extra_field_length,
         uint64_t & uncompressed_size, uint64_t & compressed_size,
-        uint64_t & local_header_offset) const {
+        uint64_t & local_header_offset) {
         if(!extra_field || extra_field_length == 0) return false;
 
         size_t pos = 0;
@@ -403,21 +2549,18 @@ struct zip_archive {
             uint16_t header_id = *reinterpret_cast<const uint16_t *>(extra_field + pos);
             uint16_t data_size = *reinterpret_cast<const uint16_t *>(extra_field + pos + 2);
 
+            if(pos + 4 + data_size > extra_field_length) break;
+
             if(header_id == zip_constants::SIGNATURE_ZIP64_EXTENDED_INFO) {
                 const uint8_t * data = extra_field + pos + 4;
                 size_t data_pos = 0;
 
                 // Parse ZIP64 extended information
-                if(data_pos + 8 <= data_size) {
-                    uncompressed_size = *reinterpret_cast<const uint64_t *>(data + data_pos);
-                    data_pos += 8;
-                }
-                if(data_pos + 8 <= data_size) {
-                    compressed_size = *reinterpret_cast<const uint64_t *>(data + data_pos);
-                    data_pos += 8;
-                }
-                if(data_pos + 8 <= data_size) {
-                    local_header_offset = *reinterpret_cast<const uint64_t *>(data + data_pos);
+                for(uint64_t * value : {&uncompressed_size, &compressed_size, &local_header_offset}) {
+                    if(*value != 0xFFFFFFFF) continue;
+                    if(data_pos + 8 > data_size) break;
+
+                    *value = *reinterpret_cast<const uint64_t *>(data + data_pos);
                     data_pos += 8;
                 }
 
@@ -430,23 +2573,33 @@ struct zip_archive {
         return false;
     }
 
+    // Get the 64-bit sizes and local header offset of a central directory entry
+    static void get_entry_extents(const zip_dir_entry * entry,
+        uint64_t & uncompressed_size, uint64_t & compressed_size, uint64_t & local_header_offset) {
+        uncompressed_size = entry->uncompressed_size;
+        compressed_size = entry->compressed_size;
+        local_header_offset = entry->local_header_offset;
+
+        // Check for ZIP64 extended information in central directory entry
+        if(uncompressed_size == 0xFFFFFFFF || compressed_size == 0xFFFFFFFF || local_header_offset == 0xFFFFFFFF) {
+            const uint8_t * extra_field = reinterpret_cast<const uint8_t *>(entry->file_name) + entry->filename_length;
+            parse_zip64_extended_info(extra_field, entry->extra_field_length,
+                uncompressed_size, compressed_size, local_header_offset);
+        }
+    }
+
     // Find a central directory entry by index
     // Returns the entry pointer, or nullptr if not found
     const zip_dir_entry * find_entry_by_index(size_t index) const {
         if(!m_central_dir || index >= m_num_entries) return nullptr;
 
-        // Use the entry offset table for direct access by index
-        if(index < m_entry_offsets.size()) {
-            size_t pos = m_entry_offsets[index];
-
-            // Get the entry data
-            const uint8_t * entry_data = m_central_dir + pos + 4;
-
-            // Return the entry
-            return reinterpret_cast<const zip_dir_entry *>(entry_data);
-        }
+        // The filename directly follows the fixed part of the entry
+        return reinterpret_cast<const zip_dir_entry *>(m_central_dir + m_index.name_offset[index]) - 1;
+    }
 
-        return nullptr;
+    // Get the filename of an entry from the index
+    const char * entry_name(size_t index) const {
+        return reinterpret_cast<const char *>(m_central_dir + m_index.name_offset[index]);
     }
 
     // Find an entry by name using binary search on the sorted entry offset table
@@ -458,44 +2611,58 @@ struct zip_archive {
     }
 
     // Check for ZIP64 support in the archive
+    // Locates the ZIP64 end of central directory record through its locator. The locator holds
+    // the record's offset relative to the archive start, which is only absolute when nothing is
+    // prepended to the archive; otherwise the record is the one immediately preceding the locator.
     void check_zip64_support(size_t eocd_pos) {
-        // First check if we need ZIP64 due to large file sizes or entry counts
-        const zip_end_of_central_dir * eocd_record = reinterpret_cast<const zip_end_of_central_dir *>(m_data + eocd_pos + 4);
-
         // Check for ZIP64 end of central directory locator
         size_t locator_pos = find_zip64_end_of_central_dir_locator(m_data, m_size, eocd_pos);
-        if(locator_pos != SIZE_MAX) {
-            const zip64_end_of_central_dir_locator * locator =
-                reinterpret_cast<const zip64_end_of_central_dir_locator *>(m_data + locator_pos + 4);
-
-            // Find ZIP64 end of central directory record
-            size_t zip64_eocd_pos = find_zip64_end_of_central_dir(m_data, m_size, locator->relative_offset_of_zip64_end);
-
-            if(zip64_eocd_pos != SIZE_MAX) {
-                // Validate ZIP64 record
-                const zip64_end_of_central_dir * zip64_eocd = reinterpret_cast<const zip64_end_of_central_dir *>(m_data + zip64_eocd_pos + 4);
-                if(zip64_eocd->size_of_record >= 44) { // Minimum size minus signature and size field
-                    m_is_zip64 = true;
-                }
+        if(locator_pos == SIZE_MAX) return;
+
+        const zip64_end_of_central_dir_locator * locator =
+            reinterpret_cast<const zip64_end_of_central_dir_locator *>(m_data + locator_pos + 4);
+
+        // Find ZIP64 end of central directory record, it must end right at the locator
+        auto find_record = [&](uint64_t offset) -> size_t {
+            size_t pos = find_zip64_end_of_central_dir(m_data, locator_pos, offset); if(pos == SIZE_MAX) {
+                return SIZE_MAX;
             }
+
+            // Validate ZIP64 record
+            const zip64_end_of_central_dir * zip64_eocd = reinterpret_cast<const zip64_end_of_central_dir *>(m_data + pos + 4);
+            if(zip64_eocd->size_of_record < 44) return SIZE_MAX; // Minimum size minus signature and size field
+            if(zip64_eocd->size_of_record > locator_pos - pos - 12) return SIZE_MAX;
+
+            return pos;
+        };
+
+        size_t zip64_eocd_pos = find_record(locator->relative_offset_of_zip64_end); {
+            if(zip64_eocd_pos == SIZE_MAX && locator_pos >= 56) zip64_eocd_pos = find_record(locator_pos - 56);
         }
 
-        // Also check if we need ZIP64 due to 32-bit overflow
-        // if(!m_is_zip64 && eocd_record) {
-        //     if(eocd_record->num_entries_total == 0xFFFF ||
-        //         eocd_record->central_dir_size == 0xFFFFFFFF ||
-        //         eocd_record->central_dir_offset == 0xFFFFFFFF) {
-        //         // These values indicate ZIP64 is needed but we don't have the ZIP64 structures
-        //         throw std::runtime_error("ZIP64 required but ZIP64 structures not found");
-        //     }
-        // }
+        if(zip64_eocd_pos != SIZE_MAX) {
+            m_is_zip64 = true; m_zip64_eocd_pos = zip64_eocd_pos;
+        }
     }
 
-    // Find an entry index by name using binary search on the sorted entry offset table
+    // Find an entry index by name using the name hash table
     // Returns the index of the entry, or total_entries if not found
     size_t find_entry_index(const char * name, size_t len) const {
         if(!m_central_dir || !name || len == 0) return m_num_entries;
 
+        if(m_index.hash_slots.size() > 0) {
+            size_t index = m_index.find_hash(name, len, [this](size_t i) { return entry_name(i); });
+            return index == SIZE_MAX ? m_num_entries : index;
+        }
+
+        return search_entry_index(name, len);
+    }
+
+    // Find an entry index by name using binary search on the sorted index
+    // Returns the index of the entry, or total_entries if not found
+    size_t search_entry_index(const char * name, size_t len) const {
+        if(!m_central_dir || !name || len == 0) return m_num_entries;
+
         // Use binary search to find the entry
         size_t left = 0;
         size_t right = m_num_entries;
@@ -503,34 +2670,21 @@ struct zip_archive {
         while(left < right) {
             size_t mid = left + (right - left) / 2;
 
-            const zip_dir_entry * entry = find_entry_by_index(mid);
-            if(!entry) {
-                // If we can't get the entry, try linear search from here
-                for(size_t i = left; i < right; ++i) {
-                    entry = find_entry_by_index(i);
-                    if(!entry) continue;
-
-                    // Check if the filename matches
-                    if(entry->filename_length == len &&
-                        memcmp(entry->file_name, name, len) == 0) {
-                        return i;
-                    }
-                }
-                return m_num_entries;
-            }
+            const char * entry_name = this->entry_name(mid);
+            size_t entry_length = m_index.name_length[mid];
 
             // Compare filenames
             int cmp;
-            if(entry->filename_length == len) {
-                cmp = memcmp(entry->file_name, name, len);
+            if(entry_length == len) {
+                cmp = memcmp(entry_name, name, len);
             } else {
                 // Compare up to the shorter length first
-                size_t min_len = std::min<size_t>(entry->filename_length, len);
-                cmp = memcmp(entry->file_name, name, min_len);
+                size_t min_len = std::min<size_t>(entry_length, len);
+                cmp = memcmp(entry_name, name, min_len);
 
                 // If they match up to the shorter length, the shorter one comes first
                 if(cmp == 0) {
-                    cmp = (entry->filename_length < len) ? -1 : 1;
+                    cmp = (entry_length < len) ? -1 : 1;
                 }
             }
 
@@ -546,30 +2700,41 @@ struct zip_archive {
         return m_num_entries; // Not found
     }
 
+    // Find the first entry in sorted order whose name is not less than the prefix
+    // Entries starting with the prefix are contiguous from there
+    size_t lower_bound_index(std::string_view const & prefix) const {
+        size_t left = 0;
+        size_t right = m_num_entries;
+
+        while(left < right) {
+            size_t mid = left + (right - left) / 2;
+
+            std::string_view filename = get_filename(mid);
+
+            // Compare with prefix
+            if(filename.compare(0, prefix.size(), prefix) >= 0) {
+                right = mid;
+            } else {
+                left = mid + 1;
+            }
+        }
+
+        return left;
+    }
+
     // Get a filename by index
     std::string_view get_filename(size_t index) const {
-        const zip_dir_entry * entry = find_entry_by_index(index); {
-            if(!entry) return {};
-        }
+        if(!m_central_dir || index >= m_num_entries) return {};
 
-        return std::string_view(reinterpret_cast<const char *>(entry->file_name), entry->filename_length);
+        return std::string_view(entry_name(index), m_index.name_length[index]);
     }
 
     // Get a pointer to the file data and its size
     std::pair<const uint8_t *, size_t> get_file_data(size_t index) const {
-        const zip_dir_entry * entry = find_entry_by_index(index);
-        if(!entry) return {nullptr, 0};
+        if(!m_central_dir || index >= m_num_entries) return {nullptr, 0};
 
-        // Check for ZIP64 extended information in central directory entry
-        uint64_t uncompressed_size = entry->uncompressed_size;
-        uint64_t compressed_size = entry->compressed_size;
-        uint64_t local_header_offset = entry->local_header_offset;
-
-        if(m_is_zip64 && entry->extra_field_length > 0) {
-            const uint8_t * extra_field = reinterpret_cast<const uint8_t *>(entry->file_name) + entry->filename_length;
-            parse_zip64_extended_info(extra_field, entry->extra_field_length,
-                uncompressed_size, compressed_size, local_header_offset);
-        }
+        uint64_t compressed_size = m_index.compressed_size[index];
+        uint64_t local_header_offset = m_index.local_header_offset[index];
 
         // The local header offset is relative to the start of the ZIP archive
         size_t absolute_header_offset = m_zip_base_offset + local_header_offset;
@@ -582,16 +2747,7 @@ struct zip_archive {
         // Verify local header signature
         if(local_header_ptr[0] != 'P' || local_header_ptr[1] != 'K' ||
             local_header_ptr[2] != 0x03 || local_header_ptr[3] != 0x04) {
-            absolute_header_offset = m_zip_base_offset + (local_header_offset | 0x0100000000ll);
-            
-            if(absolute_header_offset + 30 > m_size) return {nullptr, 0};
-            
-            local_header_ptr = m_data + absolute_header_offset;
-
-            if(local_header_ptr[0] != 'P' || local_header_ptr[1] != 'K' ||
-                local_header_ptr[2] != 0x03 || local_header_ptr[3] != 0x04) {
-                return {nullptr, 0};
-            }
+            return {nullptr, 0};
         }
 
         // Get direct access to the local header
@@ -610,81 +2766,142 @@ struct zip_archive {
         return {file_data_ptr, static_cast<size_t>(compressed_size)};
     }
 
-    // Get file info by index
+    // Get file metadata by index, from the central directory only
+    zip_file_stat get_file_stat(size_t index) const {
+        if(!m_central_dir || index >= m_num_entries) return {};
+
+        // Populate the stat structure
+        zip_file_stat st; {
+            st.filename = std::string_view(entry_name(index), m_index.name_length[index]);
+            st.compressed_size = static_cast<size_t>(m_index.compressed_size[index]);
+            st.uncompressed_size = static_cast<size_t>(m_index.uncompressed_size[index]);
+            st.mod_time = m_index.dos_time[index];
+            st.compression = static_cast<zip_compression_method>(m_index.method[index]);
+            st.is_directory = (m_index.flags[index] & zip_entry_index::FLAG_DIRECTORY) != 0;
+            st.crc = m_index.crc32[index];
+        }
+
+        return st;
+    }
+
+    // Check if the entry is a directory (name ends with '/')
+    bool is_directory(size_t index) const {
+        if(!m_central_dir || index >= m_num_entries) return false;
+
+        return (m_index.flags[index] & zip_entry_index::FLAG_DIRECTORY) != 0;
+    }
+
+    // Get file info by index, this resolves the data pointer through the local file header
     zip_file_info get_file_info(size_t index) const {
-        const zip_dir_entry * entry = find_entry_by_index(index); {
-            if(!entry) return {};
+        zip_file_info info; {
+            static_cast<zip_file_stat &>(info) = get_file_stat(index);
         }
 
         // Get the compressed data pointer
-        auto [data_ptr, data_size] = get_file_data(index);
+        info.raw_ptr = get_file_data(index).first;
 
-        // Check if the file is a directory (ends with '/')
-        bool is_directory = false; {
-            if(entry->filename_length > 0) {
-                is_directory = (reinterpret_cast<const char *>(entry->file_name)[entry->filename_length - 1] == '/');
-            }
+        return info;
+    }
+
+    // Get a streaming reader by index, nothing is decompressed until the first read
+    zip_stream get_file_stream(size_t index) const {
+        zip_stream stream; {
+            static_cast<zip_file_stat &>(stream) = get_file_stat(index);
         }
 
-        // Check for ZIP64 extended information in central directory entry
-        uint64_t uncompressed_size = entry->uncompressed_size;
-        uint64_t compressed_size = entry->compressed_size;
+        stream.raw_ptr = get_file_data(index).first;
 
-        if(m_is_zip64 && entry->extra_field_length > 0) {
-            const uint8_t * extra_field = reinterpret_cast<const uint8_t *>(entry->file_name) + entry->filename_length;
-            uint64_t dummy_offset; // We don't need the offset for file info
-            parse_zip64_extended_info(extra_field, entry->extra_field_length,
-                uncompressed_size, compressed_size, dummy_offset);
-        }
+        return stream;
+    }
 
-        // Populate the info structure
-        zip_file_info info; {
-            info.filename = std::string_view(reinterpret_cast<const char *>(entry->file_name), entry->filename_length);
-            info.compressed_size = static_cast<size_t>(compressed_size);
-            info.uncompressed_size = static_cast<size_t>(uncompressed_size);
-            info.mod_time = entry->dos_time;
-            info.compression = static_cast<zip_compression_method>(entry->compression);
-            info.raw_ptr = data_ptr;
-            info.is_directory = is_directory;
+    // Decompress length bytes of an entry at offset straight into dst, returns the bytes written or -1
+    // A range from the start is decoded only that far, the whole entry is checked against its CRC
+    // like data() and any other range goes through a stream skipping to it.
+    ptrdiff_t decompress_into(size_t index, uint64_t offset, uint8_t * dst, size_t length) const {
+        auto info = get_file_info(index); if(!info.raw_ptr || info.is_directory) {
+            return -1;
         }
 
-        return info;
+        if(offset >= info.uncompressed_size) return 0;
+
+        length = static_cast<size_t>(std::min<uint64_t>(length, info.uncompressed_size - offset));
+
+        if(offset == 0) return info.prefix_into(dst, length) ? static_cast<ptrdiff_t>(length) : -1;
+
+        return get_file_stream(index).read(offset, dst, length);
+    }
+
+    static bool is_central_dir_signature(const uint8_t * p) {
+        return p[0] == 'P' && p[1] == 'K' && p[2] == 0x01 && p[3] == 0x02;
     }
 
     // Find the base offset of the ZIP archive using EOCD record
-    // This algorithm searches from the end of the file to find the EOCD signature,
-    // then uses the central directory offset to calculate the ZIP archive start position
-    size_t find_zip_base_offset(const zip_end_of_central_dir * eocd_record) {
-        const size_t max_entry_size = 4096;
-        size_t offset = m_size - 4;
-        size_t last_offset = offset;
+    // The central directory immediately precedes the EOCD record, so its position follows from
+    // the record's size field and the base offset from its offset field, whatever is prepended
+    // to the archive. Only the tail of the buffer is touched.
+    // For ZIP64 archives the fields come from the ZIP64 record, which the central directory precedes.
+    size_t find_zip_base_offset(size_t eocd_pos, const zip_end_of_central_dir * eocd_record) {
+        uint64_t num_entries = eocd_record->num_entries_total;
+        uint64_t central_dir_size = eocd_record->central_dir_size;
+        uint64_t central_dir_offset = eocd_record->central_dir_offset;
+
+        if(m_is_zip64) {
+            const zip64_end_of_central_dir * zip64_eocd = reinterpret_cast<const zip64_end_of_central_dir *>(m_data + m_zip64_eocd_pos + 4);
+
+            num_entries = zip64_eocd->num_entries_total;
+            central_dir_size = zip64_eocd->central_dir_size;
+            central_dir_offset = zip64_eocd->central_dir_offset;
+            eocd_pos = m_zip64_eocd_pos;
+        }
+
+        // Saturated fields without a ZIP64 record, fall back to scanning
+        bool saturated = central_dir_size == 0xFFFFFFFF || central_dir_offset == 0xFFFFFFFF;
+
+        if(!saturated && central_dir_size <= eocd_pos && central_dir_offset <= eocd_pos - central_dir_size) {
+            size_t central_dir_pos = eocd_pos - static_cast<size_t>(central_dir_size);
+
+            if(num_entries == 0 || (central_dir_size >= 46 && is_central_dir_signature(m_data + central_dir_pos))) {
+                m_central_dir = m_data + central_dir_pos;
+                m_central_dir_size = static_cast<size_t>(central_dir_size);
+                m_zip_central_dir_offset = central_dir_pos;
+
+                // Only a hint, the 16-bit count wraps in archives of more than 65535 entries written
+                // without ZIP64 records, the walk over the central directory counts the entries
+                m_num_entries = static_cast<size_t>(std::min<uint64_t>(num_entries, m_central_dir_size / 46));
+
+                return central_dir_pos - static_cast<size_t>(central_dir_offset);
+            }
+        }
+
+        return scan_zip_base_offset(eocd_pos);
+    }
 
-        size_t c = 0; while(true) {
-            if(offset > last_offset) break;
-            if((last_offset - offset) > max_entry_size) break;
+    // Fallback for archives whose EOCD fields do not describe the central directory:
+    // search backward from the EOCD record for central directory signatures, then forward
+    // for the first local file header
+    size_t scan_zip_base_offset(size_t eocd_pos) {
+        const size_t max_entry_size = 4096;
+        size_t last_offset = eocd_pos;
 
-            const uint8_t * central_dir = m_data + offset;
+        // Each central directory entry must start within max_entry_size of the next one
+        size_t c = 0; while(last_offset > 0) {
+            size_t window = last_offset > max_entry_size ? last_offset - max_entry_size : 0;
 
-            // Check for central directory signature (PK\x01\x02)
-            if(central_dir[0] == 'P' && central_dir[1] == 'K' &&
-                central_dir[2] == 0x01 && central_dir[3] == 0x02) {
-                ++c; last_offset = offset;
+            size_t pos = zip_scan::rfind(m_data + window, last_offset - window + 3, zip_constants::SIGNATURE_ZIP_CENTRAL_DIR_ENTRY); if(pos == SIZE_MAX) {
+                break;
             }
 
-            offset--;
+            ++c; last_offset = window + pos;
         }
 
         if(c > 0) {
             m_num_entries = c; m_central_dir = m_data + last_offset;
+            m_central_dir_size = eocd_pos - last_offset;
+            m_zip_central_dir_offset = last_offset;
         }
 
-        c = 0; offset = 0; while(offset < m_size - 4) {
-            if(*(reinterpret_cast<const uint32_t *>(m_data + offset)) == zip_constants::SIGNATURE_ZIP) {
-                return offset;
-                // printf("%zx, %zx\n", c++, offset);
-            }
-
-            ++offset;
+        size_t offset = zip_scan::find(m_data, m_size, zip_constants::SIGNATURE_ZIP); if(offset != SIZE_MAX) {
+            return offset;
         }
 
         return 0;
@@ -693,20 +2910,28 @@ struct zip_archive {
     // Parse the end of central directory record
     // Store the central directory information
     void parse_central_directory(const zip_end_of_central_dir * eocd_record) {
-        if(m_num_entries == 0) return;
+        m_index.clear(); if(!m_central_dir || m_central_dir_size < 46) {
+            m_num_entries = 0; build_index({}); return;
+        }
+
+        // Offsets are kept in 32 bits to keep the index compact
+        if(m_central_dir_size > UINT32_MAX) {
+            throw std::runtime_error("Central directory too large");
+        }
+
+        // Collect the offset of each entry in the central directory
+        std::vector<uint32_t> offsets; offsets.reserve(std::min(m_num_entries, m_central_dir_size / 46));
 
-        // Build the entry offset table for fast access by index
-        m_entry_offsets.clear(); m_entry_offsets.reserve(m_num_entries);
+        // Walk the records until the central directory runs out, whatever the recorded entry count
+        size_t pos = 0; while(pos + 46 <= m_central_dir_size) {
 
-        size_t pos = 0; for(size_t i = 0; i < m_num_entries; ++i) {
             // Verify central directory entry signature
-            if(m_central_dir[pos] != 'P' || m_central_dir[pos + 1] != 'K' ||
-                m_central_dir[pos + 2] != 0x01 || m_central_dir[pos + 3] != 0x02) {
+            if(!is_central_dir_signature(m_central_dir + pos)) {
                 break;
             }
 
             // Store the offset to this entry
-            m_entry_offsets.push_back(static_cast<uint32_t>(pos));
+            offsets.push_back(static_cast<uint32_t>(pos));
 
             // Get the entry data
             const zip_dir_entry * current_entry = reinterpret_cast<const zip_dir_entry *>(m_central_dir + pos + 4);
@@ -715,23 +2940,195 @@ struct zip_archive {
             pos += 46 + current_entry->filename_length + current_entry->extra_field_length + current_entry->comment_length;
         }
 
+        // The recorded entry count may have wrapped or been an upper bound
+        m_num_entries = offsets.size();
+
         // Sort the offset table by filename for binary search
-        std::sort(m_entry_offsets.begin(), m_entry_offsets.end(),
-            [this](uint32_t a, uint32_t b) {
-                const zip_dir_entry * entry_a = reinterpret_cast<const zip_dir_entry *>(m_central_dir + a + 4);
-                const zip_dir_entry * entry_b = reinterpret_cast<const zip_dir_entry *>(m_central_dir + b + 4);
+        sort_entries(offsets);
 
-                // Compare filenames
-                size_t min_len = std::min<size_t>(entry_a->filename_length, entry_b->filename_length);
-                int cmp = memcmp(entry_a->file_name, entry_b->file_name, min_len);
+        build_index(offsets);
+    }
 
-                // If they match up to the shorter length, the shorter one comes first
-                if(cmp == 0) {
-                    return entry_a->filename_length < entry_b->filename_length;
+    // Sort key of an entry: 8 name bytes in big-endian order starting at the current depth, so that
+    // comparing keys compares names without touching the central directory unless the prefixes tie
+    struct sort_key {
+        uint64_t prefix;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    static uint64_t name_prefix(const char * name, size_t len) {
+        uint8_t b[8] {0}; memcpy(b, name, std::min<size_t>(len, 8));
+
+        uint64_t r = 0; for(int i = 0; i < 8; ++i) r = (r << 8) | b[i]; return r;
+    }
+
+    // Byte order of the names, the shorter one first when one is a prefix of the other
+    // Both names agree on their first depth bytes and the prefixes hold the 8 bytes after that.
+    bool key_less(sort_key const & a, sort_key const & b, size_t depth = 0) const {
+        if(a.prefix != b.prefix) return a.prefix < b.prefix;
+
+        // Equal prefixes, the names agree up to the shorter length if that is within the prefix
+        size_t min_len = std::min(a.length, b.length); if(min_len > depth + 8) {
+            int cmp = memcmp(m_central_dir + a.offset + 46 + depth + 8, m_central_dir + b.offset + 46 + depth + 8, min_len - depth - 8);
+            if(cmp != 0) return cmp < 0;
+        }
+
+        return a.length < b.length;
+    }
+
+    // MSD radix sort of keys on their prefix bytes, starting at byte (0 is the most significant)
+    // Small buckets fall back to comparison sorting. Once a bucket agrees on all 8 prefix bytes,
+    // names ending within them go first by length and the rest is re-keyed with the next 8 bytes.
+    void radix_sort(sort_key * keys, sort_key * tmp, size_t n, int byte, size_t depth) const {
+        while(true) {
+            if(n < 64) {
+                std::sort(keys, keys + n, [this, depth](sort_key const & a, sort_key const & b) { return key_less(a, b, depth); }); return;
+            }
+
+            if(byte == 8) {
+                // Names ending within the prefix are equal up to their length and sort first
+                sort_key * rest = std::partition(keys, keys + n, [depth](sort_key const & k) { return k.length <= depth + 8; });
+
+                std::sort(keys, rest, [](sort_key const & a, sort_key const & b) { return a.length < b.length; });
+
+                size_t m = keys + n - rest; depth += 8; for(size_t i = 0; i < m; ++i) {
+                    rest[i].prefix = name_prefix(reinterpret_cast<const char *>(m_central_dir) + rest[i].offset + 46 + depth, rest[i].length - depth);
                 }
 
-                return cmp < 0;
+                keys = rest; n = m; byte = 0; continue;
+            }
+
+            int shift = 56 - 8 * byte;
+
+            size_t count[256] {0}; for(size_t i = 0; i < n; ++i) ++count[(keys[i].prefix >> shift) & 0xFF];
+
+            // All keys share this byte, go on with the next one without moving them
+            if(count[(keys[0].prefix >> shift) & 0xFF] == n) {
+                ++byte; continue;
+            }
+
+            size_t start[256]; for(size_t b = 0, sum = 0; b < 256; ++b) {
+                start[b] = sum; sum += count[b];
+            }
+
+            size_t next[256]; memcpy(next, start, sizeof(next));
+
+            for(size_t i = 0; i < n; ++i) tmp[next[(keys[i].prefix >> shift) & 0xFF]++] = keys[i];
+
+            memcpy(keys, tmp, n * sizeof(sort_key));
+
+            // Recurse into the smaller buckets and continue with the largest one, which bounds the
+            // recursion depth by log n whatever the names look like
+            size_t largest = 0; for(size_t b = 1; b < 256; ++b) {
+                if(count[b] > count[largest]) largest = b;
+            }
+
+            for(size_t b = 0; b < 256; ++b) {
+                if(b != largest && count[b] > 1) radix_sort(keys + start[b], tmp + start[b], count[b], byte + 1, depth);
+            }
+
+            keys += start[largest]; tmp += start[largest]; n = count[largest]; ++byte;
+        }
+    }
+
+    // Sort the entry offsets by name
+    // Large archives build the keys and radix sort chunks in parallel, then merge the chunks pairwise.
+    void sort_entries(std::vector<uint32_t> & offsets) const {
+        size_t n = offsets.size(); std::vector<sort_key> keys(n);
+
+        unsigned threads = n >= m_parallel_threshold ? zip_parallel::concurrency(m_threads) : 1;
+
+        zip_parallel::for_range(n, threads, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i) {
+                const zip_dir_entry * entry = reinterpret_cast<const zip_dir_entry *>(m_central_dir + offsets[i] + 4);
+                keys[i] = {name_prefix(entry->file_name, entry->filename_length), offsets[i], entry->filename_length};
+            }
+        });
+
+        auto less = [this](sort_key const & a, sort_key const & b) { return key_less(a, b); };
+
+        std::vector<sort_key> merged(n);
+
+        if(threads == 1) {
+            radix_sort(keys.data(), merged.data(), n, 0, 0);
+        } else {
+            // Chunk boundaries, one sorted run per thread
+            std::vector<size_t> bounds; for(unsigned t = 0; t <= threads; ++t) bounds.push_back(n * t / threads);
+
+            // Radix sorting re-keys tied names deeper, the merge needs their leading bytes back
+            zip_parallel::for_range(threads, threads, [&](size_t begin, size_t end) {
+                for(size_t t = begin; t < end; ++t) {
+                    radix_sort(keys.data() + bounds[t], merged.data() + bounds[t], bounds[t + 1] - bounds[t], 0, 0);
+
+                    for(size_t i = bounds[t]; i < bounds[t + 1]; ++i) {
+                        keys[i].prefix = name_prefix(reinterpret_cast<const char *>(m_central_dir) + keys[i].offset + 46, keys[i].length);
+                    }
+                }
             });
+
+            // Merge neighbouring runs until one is left
+            while(bounds.size() > 2) {
+                size_t runs = bounds.size() - 1, pairs = (runs + 1) / 2;
+
+                zip_parallel::for_range(pairs, threads, [&](size_t begin, size_t end) {
+                    for(size_t p = begin; p < end; ++p) {
+                        size_t lo = bounds[2 * p], mid = bounds[std::min(2 * p + 1, runs)], hi = bounds[std::min(2 * p + 2, runs)];
+                        std::merge(keys.begin() + lo, keys.begin() + mid, keys.begin() + mid, keys.begin() + hi, merged.begin() + lo, less);
+                    }
+                });
+
+                keys.swap(merged);
+
+                std::vector<size_t> next; for(size_t k = 0; k < bounds.size(); k += 2) next.push_back(bounds[k]);
+                if(next.back() != n) next.push_back(n);
+
+                bounds.swap(next);
+            }
+        }
+
+        for(size_t i = 0; i < n; ++i) offsets[i] = keys[i].offset;
+    }
+
+    // Fill the index columns from the sorted entry offsets
+    void build_index(std::vector<uint32_t> const & offsets) {
+        size_t n = offsets.size();
+
+        std::vector<uint64_t> uncompressed_size(n), compressed_size(n), local_header_offset(n);
+        std::vector<uint32_t> dos_time(n), crc32(n), name_offset(n);
+        std::vector<uint16_t> name_length(n), method(n);
+        std::vector<uint8_t> flags(n);
+
+        unsigned threads = n >= m_parallel_threshold ? zip_parallel::concurrency(m_threads) : 1;
+
+        zip_parallel::for_range(n, threads, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i) {
+                const zip_dir_entry * entry = reinterpret_cast<const zip_dir_entry *>(m_central_dir + offsets[i] + 4);
+
+                get_entry_extents(entry, uncompressed_size[i], compressed_size[i], local_header_offset[i]);
+
+                dos_time[i] = entry->dos_time;
+                crc32[i] = entry->crc32;
+                name_offset[i] = offsets[i] + 46;
+                name_length[i] = entry->filename_length;
+                method[i] = entry->compression;
+                flags[i] = (entry->filename_length > 0 && entry->file_name[entry->filename_length - 1] == '/') ? zip_entry_index::FLAG_DIRECTORY : 0;
+            }
+        });
+
+        m_index.uncompressed_size.assign(std::move(uncompressed_size));
+        m_index.compressed_size.assign(std::move(compressed_size));
+        m_index.local_header_offset.assign(std::move(local_header_offset));
+        m_index.dos_time.assign(std::move(dos_time));
+        m_index.crc32.assign(std::move(crc32));
+        m_index.name_offset.assign(std::move(name_offset));
+        m_index.name_length.assign(std::move(name_length));
+        m_index.method.assign(std::move(method));
+        m_index.flags.assign(std::move(flags));
+
+        m_index.build_hash(n, [this](size_t i) { return get_filename(i); });
+
+        build_tree();
     }
 
     template<typename F>
@@ -749,126 +3146,173 @@ struct zip_archive {
         }
     }
 
-    template<typename F>
-    void for_each_entry(std::string_view const & parent, F && f) {
-        // parent must be empty or ends with '/'
-        if(!(parent.empty() || parent.back() == '/')) return;
+    // Get the name of a tree node (the last path component, without trailing slash)
+    std::string_view node_name(size_t node) const {
+        return std::string_view(reinterpret_cast<const char *>(m_central_dir) + m_index.node_name_offset[node], m_index.node_name_length[node]);
+    }
 
-        // Use binary search to find the first entry that starts with parent
-        size_t start_index = 0; if(!parent.empty()) {
-            // Binary search for the first entry that starts with parent
-            size_t left = 0;
-            size_t right = m_num_entries;
+    // Get the entry index of a tree node, or SIZE_MAX for the root, implicit directories and nodes out of range
+    size_t node_entry(size_t node) const {
+        if(node >= m_index.node_count()) return SIZE_MAX;
 
-            while(left < right) {
-                size_t mid = left + (right - left) / 2;
+        uint32_t entry = m_index.node_entry[node]; return entry == zip_entry_index::NO_ENTRY ? SIZE_MAX : entry;
+    }
 
-                const zip_dir_entry * entry = find_entry_by_index(mid); {
-                    if(!entry) return;
-                }
+    bool node_is_directory(size_t node) const {
+        return node < m_index.node_count() && (m_index.node_flags[node] & zip_entry_index::FLAG_DIRECTORY) != 0;
+    }
 
-                std::string_view filename(reinterpret_cast<const char *>(entry->file_name), entry->filename_length);
+    // Find a tree node by path, components separated by '/', a trailing '/' is ignored
+    // Returns the node, 0 for the root, or SIZE_MAX if not found or the archive has no tree
+    size_t find_node(std::string_view path) const {
+        if(m_index.node_count() == 0) return SIZE_MAX;
 
-                // Compare with parent
-                if(filename.size() >= parent.size() &&
-                    memcmp(filename.data(), parent.data(), parent.size()) >= 0) {
-                    right = mid;
-                } else {
+        size_t node = 0; size_t pos = 0; while(pos < path.size()) {
+            size_t slash = path.find('/', pos); if(slash == std::string_view::npos) slash = path.size();
+
+            std::string_view name = path.substr(pos, slash - pos); pos = slash + 1;
+
+            if(name.empty()) continue;
+
+            // Binary search the children, which are sorted by name
+            size_t left = m_index.node_first_child[node];
+            size_t right = left + m_index.node_child_count[node];
+
+            while(left < right) {
+                size_t mid = left + (right - left) / 2;
+
+                if(node_name(mid) < name) {
                     left = mid + 1;
+                } else {
+                    right = mid;
                 }
             }
 
-            start_index = left;
+            if(left == m_index.node_first_child[node] + m_index.node_child_count[node] || node_name(left) != name) {
+                return SIZE_MAX;
+            }
+
+            node = left;
         }
 
-        std::string dir_name;
+        return node;
+    }
 
-        // Iterate through entries starting from the found index
-        for(size_t i = start_index; i < m_num_entries; ++i) {
-            const zip_dir_entry * entry = find_entry_by_index(i);
-            if(!entry) continue;
+    // Call f(child) for the children of a tree node, in name order
+    template<typename F>
+    void for_each_child(size_t node, F && f) const {
+        if(node >= m_index.node_count()) return;
 
-            // Get the filename as string_view
-            std::string_view filename(reinterpret_cast<const char *>(entry->file_name), entry->filename_length);
+        size_t first = m_index.node_first_child[node], last = first + m_index.node_child_count[node];
 
-            // If we've moved past entries that start with parent, we can stop
-            if(!parent.empty() && (filename.size() < parent.size() ||
-                                      filename.substr(0, parent.size()) != parent)) {
-                if(i > start_index) {
-                    // We've moved past the parent section
+        for(size_t child = first; child < last; ++child) {
+            if constexpr(std::is_void_v<decltype(f(child))>) {
+                // Function doesn't return a value, just call it
+                f(child);
+            } else {
+                // Function returns a value, check if it's true to break
+                if(f(child)) {
                     break;
                 }
-                continue;
             }
+        }
+    }
 
-            // Skip the parent directory itself
-            if(filename == parent) {
-                continue;
+    // Build the directory tree from the sorted entry names
+    // Entries sharing a directory prefix are contiguous in sorted order, so the open directories
+    // form a stack along the current path and implicit directories are synthesized when first seen.
+    void build_tree() {
+        struct node_t {
+            uint32_t parent; uint32_t name_offset; uint16_t name_length; uint32_t entry; uint8_t flags;
+        };
+
+        std::vector<node_t> nodes; nodes.reserve(m_num_entries + 1); {
+            nodes.push_back({UINT32_MAX, 0, 0, zip_entry_index::NO_ENTRY, zip_entry_index::FLAG_DIRECTORY});
+        }
+
+        // Directory prefixes (including the trailing slash) along the current path and their nodes
+        std::vector<std::pair<std::string_view, uint32_t>> stack;
+
+        for(size_t i = 0; i < m_num_entries; ++i) {
+            std::string_view name = get_filename(i); uint32_t name_offset = m_index.name_offset[i];
+
+            size_t level = 0, pos = 0; uint32_t parent = 0;
+
+            for(size_t slash; (slash = name.find('/', pos)) != std::string_view::npos; pos = slash + 1, ++level) {
+                std::string_view prefix = name.substr(0, slash + 1);
+
+                if(level < stack.size() && stack[level].first == prefix) {
+                    parent = stack[level].second; continue;
+                }
+
+                stack.resize(level);
+
+                nodes.push_back({parent, static_cast<uint32_t>(name_offset + pos), static_cast<uint16_t>(slash - pos),
+                    zip_entry_index::NO_ENTRY, zip_entry_index::FLAG_DIRECTORY});
+
+                parent = static_cast<uint32_t>(nodes.size() - 1); stack.emplace_back(prefix, parent);
             }
 
-            // For any parent (including root), only include direct children
-            // Get the relative path from parent
-            std::string_view relative_path;
-            if(!parent.empty()) {
-                relative_path = filename.substr(parent.size());
+            stack.resize(level);
+
+            if(pos == name.size()) {
+                // Explicit directory entry, its node is the last one on the path
+                if(level > 0) nodes[parent].entry = static_cast<uint32_t>(i);
             } else {
-                relative_path = filename;
+                nodes.push_back({parent, static_cast<uint32_t>(name_offset + pos), static_cast<uint16_t>(name.size() - pos),
+                    static_cast<uint32_t>(i), m_index.flags[i]});
             }
+        }
 
-            // Skip if not a direct child (contains additional slashes beyond the first one)
-            size_t slash_pos = relative_path.find('/');
-            if(slash_pos == std::string_view::npos) {
-                // No slash - this is a file directly in the parent directory
-            } else if(slash_pos == relative_path.size() - 1) {
-                // Slash at the end only - this is a directory directly in the parent
-                dir_name = relative_path.substr(0, slash_pos + 1);
-            } else {
-                // Slash in the middle - this is in a subdirectory, create virtual directory entry
-                std::string_view dname = relative_path.substr(0, slash_pos + 1); // Include the trailing slash
+        auto name_of = [this, &nodes](uint32_t n) {
+            return std::string_view(reinterpret_cast<const char *>(m_central_dir) + nodes[n].name_offset, nodes[n].name_length);
+        };
 
-                if(dname == dir_name) continue;
+        // Group the nodes by parent, children sorted by name
+        std::vector<uint32_t> order(nodes.size() - 1); {
+            for(size_t n = 1; n < nodes.size(); ++n) order[n - 1] = static_cast<uint32_t>(n);
 
-                dir_name = dname;
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+                if(nodes[a].parent != nodes[b].parent) return nodes[a].parent < nodes[b].parent;
+                return name_of(a) < name_of(b);
+            });
+        }
 
-                std::string dir_path = (std::filesystem::path(parent) / dname).string();
+        // Children range of each node within order
+        std::vector<uint32_t> child_begin(nodes.size(), 0), child_count(nodes.size(), 0); {
+            for(size_t k = order.size(); k-- > 0;) {
+                uint32_t p = nodes[order[k]].parent; child_begin[p] = static_cast<uint32_t>(k); ++child_count[p];
+            }
+        }
 
-                // Create a virtual directory entry on the stack
-                zip_fake_dir_entry virtual_entry = {};
+        // Renumber breadth first, so that the children of each node are contiguous
+        size_t n = nodes.size();
 
-                // Set DIR marker and filename
-                virtual_entry.external_file_attributes = 0x10; // Directory attribute
-                virtual_entry.filename_length = static_cast<uint16_t>(dir_path.size());
+        std::vector<uint32_t> bfs; bfs.reserve(n); bfs.push_back(0);
 
-                // Copy the directory name to the virtual entry's filename buffer
-                if(dir_path.size() < sizeof(virtual_entry.xfile_name)) {
-                    memcpy(virtual_entry.xfile_name, dir_path.data(), dir_path.size());
-                }
+        std::vector<uint32_t> node_entry(n), node_name_offset(n), node_first_child(n), node_child_count(n);
+        std::vector<uint16_t> node_name_length(n);
+        std::vector<uint8_t> node_flags(n);
 
-                // Return the directory name to the caller
-                if constexpr(std::is_void_v<decltype(f(std::declval<const zip_dir_entry *>()))>) {
-                    // Function doesn't return a value, just call it with the virtual entry
-                    f(&virtual_entry);
-                } else {
-                    // Function returns a value, check if it's true to break
-                    if(f(&virtual_entry)) {
-                        break;
-                    }
-                }
+        for(size_t k = 0; k < bfs.size(); ++k) {
+            const node_t & x = nodes[bfs[k]];
 
-                continue;
-            }
+            node_entry[k] = x.entry;
+            node_name_offset[k] = x.name_offset;
+            node_name_length[k] = x.name_length;
+            node_flags[k] = x.flags;
+            node_first_child[k] = static_cast<uint32_t>(bfs.size());
+            node_child_count[k] = child_count[bfs[k]];
 
-            // Call the function with the entry
-            if constexpr(std::is_void_v<decltype(f(std::declval<const zip_dir_entry *>()))>) {
-                // Function doesn't return a value, just call it
-                f(entry);
-            } else {
-                // Function returns a value, check if it's true to break
-                if(f(entry)) {
-                    break;
-                }
-            }
+            for(uint32_t c = 0; c < child_count[bfs[k]]; ++c) bfs.push_back(order[child_begin[bfs[k]] + c]);
         }
+
+        m_index.node_entry.assign(std::move(node_entry));
+        m_index.node_name_offset.assign(std::move(node_name_offset));
+        m_index.node_name_length.assign(std::move(node_name_length));
+        m_index.node_first_child.assign(std::move(node_first_child));
+        m_index.node_child_count.assign(std::move(node_child_count));
+        m_index.node_flags.assign(std::move(node_flags));
     }
 };
 
@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <print>
+#include <string>
+#include <vector>
+
+#include "structopt.hpp"
+#include "zip.h"
+
+using namespace std;
+
+// decompresses every entry of an archive with each decoder built in and reports their throughput, then times
+// the signature scan variants over the whole archive
+
+struct zipbench_options {
+    // archive to read
+    string archive;
+
+    // passes over the archive per decoder, the fastest one is reported
+    optional<int> runs {3};
+};
+
+STRUCTOPT(zipbench_options, archive, runs);
+
+typedef chrono::steady_clock bench_clock;
+
+struct decoder_t {
+    const char * name; zip_compression_method method;
+
+    // decompress one entry, false when it fails
+    function<bool(const uint8_t *, size_t, uint8_t *, size_t)> decode;
+
+    // smaller entries are left out
+    uint64_t min_size {0};
+};
+
+struct result_t { size_t files {0}; uint64_t bytes {0}; size_t failed {0}; double seconds {0}; };
+
+static result_t run(zip_archive & archive, decoder_t const & decoder, vector<uint8_t> & buffer) {
+    result_t r; auto start = bench_clock::now();
+
+    for(size_t i = 0; i < archive.size(); ++i) {
+        auto stat = archive.get_file_stat(i); if(stat.is_directory || stat.compression != decoder.method || stat.uncompressed_size < decoder.min_size) {
+            continue;
+        }
+
+        auto [src, size] = archive.get_file_data(i); if(!src) {
+            continue;
+        }
+
+        if(buffer.size() < stat.uncompressed_size) buffer.resize(stat.uncompressed_size);
+
+        if(decoder.decode(src, stat.compressed_size, buffer.data(), stat.uncompressed_size)) {
+            ++r.files; r.bytes += stat.uncompressed_size;
+        }
+        else {
+            ++r.failed;
+        }
+    }
+
+    r.seconds = chrono::duration<double>(bench_clock::now() - start).count(); return r;
+}
+
+struct scanner_t { const char * name; zip_scan::scan_fn find; zip_scan::scan_fn rfind; };
+
+// best time of a scan over all of data, in seconds
+static double time_scan(zip_scan::scan_fn scan, vector<uint8_t> const & data, uint32_t signature, int runs) {
+    double best = 0; for(int k = 0; k < runs; ++k) {
+        auto start = bench_clock::now(); if(scan(data.data(), data.size(), signature) != SIZE_MAX) {
+            return 0;
+        }
+
+        double t = chrono::duration<double>(bench_clock::now() - start).count(); if(k == 0 || t < best) best = t;
+    }
+
+    return best;
+}
+
+int main(int argc, char ** argv) {
+    try {
+        auto options = structopt::app("zipbench", "0.1.0").parse<zipbench_options>(argc, argv);
+
+        FILE * f = fopen(options.archive.c_str(), "rb"); if(!f) {
+            println("can't open {}", options.archive); return 1;
+        }
+
+        vector<uint8_t> data; {
+            uint8_t chunk[1 << 16]; size_t n; while((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+                data.insert(data.end(), chunk, chunk + n);
+            }
+
+            fclose(f);
+        }
+
+        zip_archive archive; archive.open(data.data(), data.size());
+
+        vector<decoder_t> decoders {
+            {"zlib", zip_compression_method::DEFLATED, [](const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+                return zip_inflate::one_shot(src, src_size, dst, dst_size, zip_decoder::ZLIB);
+            }},
+        };
+
+        if(zip_inflate::available(zip_decoder::LIBDEFLATE)) {
+            decoders.push_back({"libdeflate", zip_compression_method::DEFLATED, [](const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+                return zip_inflate::one_shot(src, src_size, dst, dst_size, zip_decoder::LIBDEFLATE);
+            }});
+        }
+
+        // the parallel inflate takes the entries decompress_into gives it, those it can't split count as failed
+        if(zip_parallel::concurrency(0) > 1) {
+            decoders.push_back({"pinflate", zip_compression_method::DEFLATED, [](const uint8_t * src, size_t src_size, uint8_t * dst, size_t dst_size) {
+                uint32_t crc = 0; return zip_pinflate::one_shot(src, src_size, dst, dst_size, 0, crc);
+            }, zip_pinflate::threshold()});
+        }
+
+#ifdef ZIP_WITH_ZSTD
+        decoders.push_back({"zstd", zip_compression_method::ZSTANDARD, zip_zstd::one_shot});
+#endif
+
+        println("{}: {} entries, {} MB", options.archive, archive.size(), data.size() >> 20);
+        println("{:>10} {:>8} {:>8} {:>10} {:>10} {:>8}", "decoder", "files", "MB", "MB/s", "files/s", "failed");
+
+        vector<uint8_t> buffer; int runs = max(options.runs.value_or(3), 1);
+
+        for(auto & decoder : decoders) {
+            result_t best; for(int k = 0; k < runs; ++k) {
+                auto r = run(archive, decoder, buffer); if(k == 0 || r.seconds < best.seconds) best = r;
+            }
+
+            if(!best.files && !best.failed) continue;
+
+            println("{:>10} {:>8} {:>8} {:>10.1f} {:>10.1f} {:>8}", decoder.name, best.files, best.bytes >> 20,
+                best.seconds > 0 ? best.bytes / best.seconds / (1 << 20) : 0.0, best.seconds > 0 ? best.files / best.seconds : 0.0, best.failed);
+        }
+
+        vector<scanner_t> scanners {{"scalar", zip_scan::find_scalar, zip_scan::rfind_scalar}};
+#if ZIP_X86
+        scanners.push_back({"sse2", zip_scan::find_sse2, zip_scan::rfind_sse2});
+
+        if(zip_cpu::get().avx2) {
+            scanners.push_back({"avx2", zip_scan::find_avx2, zip_scan::rfind_avx2});
+        }
+#endif
+
+        // a signature the archive does not hold, so that every scan covers all of it
+        uint32_t signature = 0x9E3779B9; while(zip_scan::find_scalar(data.data(), data.size(), signature) != SIZE_MAX) {
+            signature = signature * 0x9E3779B9 + 1;
+        }
+
+        println("");
+        println("{:>10} {:>10} {:>10}", "scan", "find MB/s", "rfind MB/s");
+
+        for(auto & scanner : scanners) {
+            double tf = time_scan(scanner.find, data, signature, runs), tr = time_scan(scanner.rfind, data, signature, runs);
+
+            println("{:>10} {:>10.0f} {:>10.0f}", scanner.name, tf > 0 ? data.size() / tf / (1 << 20) : 0.0, tr > 0 ? data.size() / tr / (1 << 20) : 0.0);
+        }
+    }
+    catch(structopt::exception & e) {
+        println("{}", e.what()); println("{}", e.help());
+    }
+    catch(std::exception & e) {
+        println("{}", e.what()); return 1;
+    }
+
+    return 0;
+}
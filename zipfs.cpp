@@ -5,112 +5,146 @@ using namespace std; using namespace ATL; namespace fs = filesystem; using fs::p
 const char * APP_NAME = "zipfs";
 const char * APP_VERSION = "0.1.0";
 
+// budget of decompressed data and access points cached for all archives, in MB
 const size_t DEFAULT_CACHE_SIZE = 1024;
 
+// compressed entries larger than this are streamed per handle and cached in blocks instead of decompressed whole
+const size_t STREAM_THRESHOLD = 4 << 20;
+
+// reads ending within this many bytes of the start of a cached entry decompress and cache only up
+// to their end, content sniffing never pays for the whole entry
+const size_t HEAD_SIZE = 64 << 10;
+
+// streamed compressed entries are cached in blocks of this many decompressed bytes, only those read
+const size_t BLOCK_SIZE = 1 << 20;
+
 struct zipmount_options {
     optional<string> root_directory {"x:\\zipfs"}; optional<string> mount_point {"z:\\"}; optional<string> acp {"default"};
+
+    // where to persist archive indexes (<archive name>.<path hash>.zidx), disabled when not given
+    optional<string> index_directory;
+
+    // decoder of whole entries, zlib or libdeflate, the best one built in when not given
+    optional<string> decoder;
+
+    // crc check of decompressed entries: full (before serving them), lazy (from their second read on) or none
+    optional<string> verify;
+
+    // decompressed data and access points cached for all archives, in MB
+    optional<size_t> cache_size {DEFAULT_CACHE_SIZE};
+
+    // soft share of the cache per archive, in MB, an archive beyond it evicts its own entries first, none when 0
+    optional<size_t> cache_quota {0};
+
+    // eviction policy of the cache: lru, or 2q or tinylfu to keep the working set through scans of the whole mount
+    optional<string> cache_policy {"lru"};
+
+    // where to record cache accesses for cachesim, one "<archive> <entry> <block> <cost>" line each (block -1 for
+    // whole entries), disabled when not given
+    optional<string> cache_trace;
 };
 
-STRUCTOPT(zipmount_options, root_directory, mount_point);
+STRUCTOPT(zipmount_options, root_directory, mount_point, index_directory, decoder, verify, cache_size, cache_quota, cache_policy, cache_trace);
+
+static fs::path root_directory, mount_point, index_directory;
+
+static size_t cache_budget = DEFAULT_CACHE_SIZE << 20, cache_quota = 0;
 
-static fs::path root_directory, mount_point;
+static cache_policy cache_eviction = cache_policy::LRU;
+
+static FILE * cache_trace = nullptr;
 
 static string acp;
 
-// a cache which evicts the least recently used item when it is full
-template<class Key, class Value>
-class lru_cache {
-public:
-    typedef Key key_type;
-    typedef Value value_type;
-    typedef std::list<key_type> list_type;
-    typedef struct { value_type first; typename list_type::iterator second; } xvalue_type;
-    typedef std::map<key_type, xvalue_type> map_type;
+// cached unit, a whole entry, one block of a streamed entry or its access points
+struct zipfs_key {
+    static constexpr uint32_t WHOLE = UINT32_MAX, POINTS = UINT32_MAX - 1;
 
-    lru_cache(size_t capacity) : m_capacity(capacity) {}
+    uint32_t archive {0}; int findex {0}; uint32_t block {WHOLE};
 
-    ~lru_cache() {}
+    bool operator==(zipfs_key const & other) const { return archive == other.archive && findex == other.findex && block == other.block; }
 
-    size_t size() const { return m_map.size(); }
+    struct hash {
+        size_t operator()(zipfs_key const & k) const { return size_t(((uint64_t(k.archive) << 32) | uint32_t(k.findex)) ^ (uint64_t(k.block) * 0xC2B2AE3D27D4EB4Full)); }
+    };
+};
 
-    size_t capacity() const { return m_capacity; }
+struct zipfs_cached {
+    ::zip_file_info info; std::vector<uint8_t> block;
 
-    bool empty() const { return m_map.empty(); }
+    // access points, the cost charged for them and whether they were persisted
+    shared_ptr<::zip_access_index> points; size_t points_cost {0}; bool persisted {false};
+};
 
-    bool contains(const key_type & key) { return m_map.find(key) != m_map.end(); }
+// decompressed data of all mounted archives under one budget, whole entries and blocks and access points of
+// streamed ones
+struct zipfs_cache {
+    entry_cache<zipfs_key, zipfs_cached, zipfs_key::hash> entries {cache_budget, cache_eviction};
 
-    template<typename K, typename V>
-    void insert(K && key, V && value) {
-        typename map_type::iterator i = m_map.find(key); if(i == m_map.end()) {
-            // insert item into the cache, but first check if it is full
-            if(size() >= m_capacity) {
-                // cache is full, evict the least recently used item
-                evict();
-            }
+    // cost cached per archive id, checked against the soft quota
+    map<uint32_t, size_t> used;
 
-            // insert the new item
-            m_list.push_front(std::forward<K>(key));
-            
-            // Create the xvalue_type with the value and list iterator
-            xvalue_type xvalue;
-            xvalue.first = std::forward<V>(value);
-            xvalue.second = m_list.begin();
-            
-            // Insert into the map
-            m_map.emplace(std::forward<K>(key), std::move(xvalue));
-        }
+    zipfs_cache() {
+        entries.on_evict = [this](zipfs_key const & key, size_t cost) {
+            auto it = used.find(key.archive); if(it != used.end()) it->second -= cost;
+        };
     }
 
-    value_type * get(const key_type & key) {
-        // lookup value in the cache
-        typename map_type::iterator i = m_map.find(key);
+    bool contains(uint32_t archive, int findex) { return entries.contains({archive, findex}); }
 
-        if(i == m_map.end()) return nullptr;
+    ::zip_file_info * get(uint32_t archive, int findex) {
+        auto cached = entries.get({archive, findex}); return cached ? &cached->info : nullptr;
+    }
 
-        // return the value, but first update its place in the most recently used list
-        typename list_type::iterator j = i->second.second; if(j != m_list.begin()) {
-            // move item to the front of the most recently used list
-            m_list.erase(j); m_list.push_front(key);
+    ::zip_file_info * insert(uint32_t archive, int findex, ::zip_file_info && info, size_t cost) {
+        return &insert({archive, findex}, {std::move(info), {}}, cost)->info;
+    }
 
-            // update iterator in map
-            j = m_list.begin();
-            
-            // We need to create a new xvalue_type with the same value but updated iterator
-            // Since zip_file_info is move-only, we need to move it out of the map temporarily
-            value_type temp_value(std::move(i->second.first));
-            
-            // Create new xvalue_type with the moved value and updated list iterator
-            xvalue_type xvalue;
-            xvalue.first = std::move(temp_value);
-            xvalue.second = j;
-            
-            // Update the map entry
-            m_map[key] = std::move(xvalue);
-            
-            // Return a pointer to the value in the map
-            return &m_map[key].first;
+    std::vector<uint8_t> * get_block(uint32_t archive, int findex, uint32_t block) {
+        auto cached = entries.get({archive, findex, block}); return cached ? &cached->block : nullptr;
+    }
+
+    std::vector<uint8_t> * insert_block(uint32_t archive, int findex, uint32_t block, std::vector<uint8_t> && data) {
+        size_t cost = data.size(); return &insert({archive, findex, block}, {{}, std::move(data)}, cost)->block;
+    }
+
+    zipfs_cached * get_points(uint32_t archive, int findex) { return entries.get({archive, findex, zipfs_key::POINTS}); }
+
+    // record a use of the entry's access points and charge them what they use now, they grow as the entry is
+    // read. The given ones are cached when none are, a handle keeps using its own after they were evicted.
+    zipfs_cached * charge_points(uint32_t archive, int findex, shared_ptr<::zip_access_index> const & points, bool persisted = false) {
+        zipfs_key key {archive, findex, zipfs_key::POINTS}; auto cached = entries.get(key); if(!cached) {
+            size_t cost = points->memory_usage(); return insert(key, {{}, {}, points, cost, persisted}, cost);
         }
-        else {
-            // the item is already at the front of the most recently
-            // used list so just return it
-            return &i->second.first;
+
+        size_t cost = cached->points->memory_usage(); if(cost != cached->points_cost) {
+            used[archive] = used[archive] - cached->points_cost + cost; cached->points_cost = cost; entries.recharge(key, cost);
         }
+
+        return cached;
     }
 
-    void clear() { m_map.clear(); m_list.clear(); }
+    void drop(uint32_t archive) {
+        entries.erase_if([archive](zipfs_key const & k) { return k.archive == archive; }); used.erase(archive);
+    }
 
 private:
-    void evict() {
-        // evict item from the end of most recently used list
-        typename list_type::iterator i = --m_list.end(); {
-            m_map.erase(*i); m_list.erase(i);
+    zipfs_cached * insert(zipfs_key const & key, zipfs_cached && value, size_t cost) {
+        if(auto cached = entries.peek(key)) return cached;
+
+        // an archive beyond its quota makes room from its own entries, in eviction order, before others lose theirs
+        if(cache_quota) {
+            while(used[key.archive] + cost > cache_quota && entries.evict_if([archive = key.archive](zipfs_key const & k) { return k.archive == archive; }));
         }
-    }
 
-private:
-    map_type m_map; list_type m_list; size_t m_capacity;
+        used[key.archive] += cost; return entries.insert(key, std::move(value), cost);
+    }
 };
 
+static zipfs_cache & $cache() {
+    static zipfs_cache cache; return cache;
+}
+
 static struct ok_type {
     bool epilogue {false};
 
@@ -163,6 +197,17 @@ struct archive_path {
     operator bool() const { return !is_root(); }
 };
 
+// per open file state, kept in DokanFileInfo->Context
+struct zipfs_handle {
+    int findex {-1};
+
+    // access points of the entry, shared with other handles to it
+    shared_ptr<::zip_access_index> points;
+
+    // inflate cursor of streamed entries, null for entries read through the cache
+    unique_ptr<::zip_stream> stream;
+};
+
 struct zipfs_archive {
     enum { NONE, FILE, DIR };
 
@@ -187,15 +232,32 @@ struct zipfs_archive {
     // New implementation using zip.h
     ::zip_archive archive; 
     size_t size {0}; 
-    lru_cache<int, ::zip_file_info> cache {DEFAULT_CACHE_SIZE}; 
+    uint32_t id {next_id()}; // key of the archive's entries in the shared cache
     CAtlFileMappingBase fmapping;
+    CAtlFileMappingBase imapping; // persisted index, the archive index refers into it
+    string archive_fname;
+    string index_name; // persisted files of the archive are named after it, see open()
 
     zipfs_archive() = default;
 
+    // cached entries alias the mapping, they go before it is unmapped
+    ~zipfs_archive() { $cache().drop(id); }
+
+    static uint32_t next_id() { static uint32_t n = 0; return n++; }
+
     operator bool() const { return fmapping.GetData() != nullptr; }
 
     int open(string const & fname) {
-        CAtlFile f; {
+        archive_fname = fname;
+
+        // archives of the same name in different directories keep their persisted files apart by a hash of the full path
+        error_code ec; auto full = fs::weakly_canonical(path(fname), ec).string(); if(ec) {
+            full = fname;
+        }
+
+        index_name = format("{}.{:08x}", path(fname).filename().string(), zip_crc32::update(0, reinterpret_cast<const uint8_t *>(full.data()), full.size()));
+
+        CAtlFile f; FILETIME ftime {0}; {
             if(f.Create(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL) != S_OK) {
                 return -1;
             }
@@ -203,10 +265,31 @@ struct zipfs_archive {
             if(fmapping.MapFile(f) != S_OK) {
                 return -1;
             }
+
+            f.GetFileTime(nullptr, nullptr, &ftime);
         }
 
         try {
-            archive.open(static_cast<uint8_t*>(fmapping.GetData()), fmapping.GetMappingSize());
+            auto data = static_cast<uint8_t*>(fmapping.GetData()); auto dsize = fmapping.GetMappingSize();
+
+            if(index_directory.empty()) {
+                archive.open(data, dsize);
+            }
+            else {
+                uint64_t mtime = (uint64_t(ftime.dwHighDateTime) << 32) | ftime.dwLowDateTime;
+
+                auto ipath = (index_directory / (index_name + ".zidx")).string();
+
+                // adopt the persisted index if it matches the archive, otherwise parse and persist it
+                CAtlFile fi; if(fi.Create(ipath.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL) == S_OK) {
+                    imapping.MapFile(fi); fi.Close();
+                }
+
+                if(!archive.open(data, dsize, static_cast<uint8_t*>(imapping.GetData()), imapping.GetData() ? imapping.GetMappingSize() : 0, mtime)) {
+                    imapping.Unmap(); save_index(ipath);
+                }
+            }
+
             size = archive.size();
             
             // ::FILE * fp = fopen("r:/zipfs.txt", "w");
@@ -221,7 +304,23 @@ struct zipfs_archive {
             // fclose(fp);
             return 0;
         } catch(const std::runtime_error& e) {
-            return -1;
+            // an archive that failed to parse reports itself closed, nothing reads its index
+            imapping.Unmap(); fmapping.Unmap(); size = 0; return -1;
+        }
+    }
+
+    void save_index(string const & ipath) {
+        auto blob = archive.save_index();
+
+        CAtlFile fo; if(fo.Create(ipath.c_str(), GENERIC_WRITE, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL) != S_OK) {
+            return;
+        }
+
+        // a partially written index is rejected by its recorded size
+        for(size_t pos = 0; pos < blob.size();) {
+            DWORD n = (DWORD)std::min<size_t>(blob.size() - pos, 1 << 30); if(fo.Write(blob.data() + pos, n) != S_OK) break;
+
+            pos += n;
         }
     }
 
@@ -232,7 +331,7 @@ struct zipfs_archive {
             return r;
         }
 
-        auto info = this->archive.get_file_info(findex);
+        auto info = this->archive.get_file_stat(findex);
         
         stat_t r;
         r.fpath = std::string(info.filename);
@@ -246,112 +345,189 @@ struct zipfs_archive {
     entry_t locate(string const & fname) {
         if(fname.empty() || fname == "/") return {zipfs_archive::DIR, -1};
 
-        // Find the entry by name
-        size_t index = archive.find_entry_index(fname.c_str(), fname.size());
-        
-        if(index == archive.size()) {
-            // Try with trailing slash for directories
-            string dname = fname + '/';
-            index = archive.find_entry_index(dname.c_str(), dname.size());
-            
-            if(index != archive.size()) {
-                return {zipfs_archive::DIR, static_cast<int>(index)};
-            }
-            
-            // Try to find any entries that start with this directory name
-            for(size_t i = 0; i < archive.size(); i++) {
-                auto filename = archive.get_filename(i);
-                if(filename.size() > dname.size() && 
-                   std::string_view(filename).substr(0, dname.size()) == dname) {
-                    return {zipfs_archive::DIR, static_cast<int>(i)};
-                }
-            }
-            
+        // Walk the directory tree, implicit directories included
+        size_t node = archive.find_node(fname); if(node == SIZE_MAX) {
             return {};
         }
-        
-        auto info = archive.get_file_info(index);
-        return {info.is_directory ? zipfs_archive::DIR : zipfs_archive::FILE, static_cast<int>(index)};
-    }
-
-    std::string_view read(int findex) {
-        // Try cache first
-        auto cached_info = this->cache.get(findex);
-        if(cached_info) {
-            // Get the decompressed data from cached zip_file_info
-            // Handle non-const data() method
-            const uint8_t* data = cached_info->data();
-            if(!data) {
+
+        size_t index = archive.node_entry(node);
+
+        return {archive.node_is_directory(node) ? zipfs_archive::DIR : zipfs_archive::FILE, index == SIZE_MAX ? -1 : static_cast<int>(index)};
+    }
+
+    // decompressed data of an entry, only a prefix of at least need bytes when that is less
+    std::string_view read(int findex, size_t need = SIZE_MAX) {
+        // Try cache first, entries not cached are added, charged their decompressed size, stored entries alias the mapping and cost nothing
+        auto cached_info = $cache().get(id, findex); bool decoded = cached_info && cached_info->data_ptr != nullptr; if(!cached_info) {
+            auto info = archive.get_file_info(findex);
+            if(!info.raw_ptr) {
                 return {}; // Return empty string_view
             }
-            
-            // Create a string_view from the data
-            return std::string_view(reinterpret_cast<const char*>(data), cached_info->uncompressed_size);
+
+            size_t cost = info.compression == zip_compression_method::NONE ? 0 : info.uncompressed_size;
+
+            cached_info = $cache().insert(id, findex, std::move(info), cost);
         }
-        
-        // Not in cache, get the file info
-        auto info = archive.get_file_info(findex);
-        if(!info.raw_ptr) {
+
+        if(cache_trace) {
+            fprintf(cache_trace, "%u %d -1 %zu\n", id, findex, cached_info->compression == zip_compression_method::NONE ? size_t(0) : size_t(cached_info->uncompressed_size));
+        }
+
+        // Get the decompressed data from cached zip_file_info
+        const uint8_t* data = need < cached_info->uncompressed_size ? cached_info->head(need) : cached_info->data();
+        if(!data) {
             return {}; // Return empty string_view
         }
-        
-        // Add to cache
-        this->cache.insert(findex, std::move(info));
-        
-        // Try again with the cached entry
-        return read(findex);
+
+        // lazily checked entries serve the read that decompressed them, later ones wait for the check
+        if(decoded && zip_crc32::verify() == zip_verify::LAZY && cached_info->compression != zip_compression_method::NONE && !cached_info->verify()) {
+            return {};
+        }
+
+        // Create a string_view from the data, the head while the rest was not needed
+        return std::string_view(reinterpret_cast<const char*>(data), cached_info->data_ptr ? cached_info->uncompressed_size : cached_info->head_size);
     }
 
-    template<typename F>
-    void each(string const & fname, F && f) {
-        auto ent = locate(fname); if(ent.is_dir()) {
-            // Convert fname to a format suitable for the new implementation
-            std::string dir_path = fname;
-            if(!dir_path.empty() && dir_path.back() != '/') {
-                dir_path += '/';
+    zipfs_handle * open_handle(int findex) {
+        auto h = new zipfs_handle {findex}; if(findex >= 0 && findex < size) {
+            // stored entries are read in place, large compressed ones keep an inflate cursor and cache the blocks read
+            auto info = archive.get_file_stat(findex); if(info.compression == zip_compression_method::NONE || info.uncompressed_size > STREAM_THRESHOLD) {
+                h->stream = make_unique<::zip_stream>(archive.get_file_stream(findex));
+
+                if(info.compression == zip_compression_method::DEFLATED) {
+                    h->points = access_index(findex); h->stream->access_index = h->points.get();
+                }
             }
-            
-            // Use the for_each_entry method from the new implementation
-            archive.for_each_entry(dir_path, [&](const ::zip_dir_entry* entry) {
-                if(!entry) return;
-                
-                // Get the filename
-                std::string_view filename(reinterpret_cast<const char*>(entry->file_name), entry->filename_length);
-                
-                // Skip the directory itself
-                if(filename == dir_path) return;
-                
-                // Get the relative path from the directory
-                std::string_view relative_path;
-                if(!dir_path.empty()) {
-                    relative_path = filename.substr(dir_path.size());
-                } else {
-                    relative_path = filename;
+        }
+
+        return h;
+    }
+
+    void close_handle(zipfs_handle * h) {
+        // persist access points once they cover the whole entry
+        auto cached = h && h->points ? $cache().charge_points(id, h->findex, h->points) : nullptr; if(cached && cached->points == h->points && h->points->complete && !index_directory.empty()) {
+            if(!cached->persisted) {
+                cached->persisted = true; auto blob = archive.save_access_index(h->findex, *h->points);
+
+                CAtlFile fo; if(fo.Create(access_path(h->findex).c_str(), GENERIC_WRITE, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL) == S_OK) {
+                    fo.Write(blob.data(), (DWORD)blob.size());
                 }
-                
-                // Check if this is a direct child or a deeper descendant
-                size_t slash_pos = relative_path.find('/');
-                
-                if(slash_pos == std::string_view::npos) {
-                    // This is a file directly in the directory
-                    stat_t st;
-                    st.fpath = std::string(relative_path);
-                    st.size = entry->uncompressed_size;
-                    st.mtime = 0; // No modification time in new implementation
-                    st.type = zipfs_archive::FILE;
-                    f(st);
-                } else if(slash_pos == relative_path.size() - 1) {
-                    // This is a directory directly in the parent
-                    stat_t st;
-                    st.fpath = std::string(relative_path.substr(0, slash_pos));
-                    st.size = 0;
-                    st.mtime = 0;
-                    st.type = zipfs_archive::DIR;
-                    f(st);
+            }
+        }
+
+        delete h;
+    }
+
+    string access_path(int findex) {
+        return (index_directory / format("{}.{}.zpts", index_name, findex)).string();
+    }
+
+    shared_ptr<::zip_access_index> access_index(int findex) {
+        if(auto cached = $cache().get_points(id, findex)) {
+            return cached->points;
+        }
+
+        auto points = make_shared<::zip_access_index>(); bool persisted = false; if(!index_directory.empty()) {
+            // adopt persisted access points if they match the entry
+            CAtlFile f; ULONGLONG fsize = 0; if(f.Create(access_path(findex).c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL) == S_OK && f.GetSize(fsize) == S_OK && fsize < (1ull << 32)) {
+                vector<uint8_t> blob(fsize); DWORD nread = 0; if(f.Read(blob.data(), (DWORD)fsize, nread) == S_OK && nread == fsize) {
+                    persisted = archive.load_access_index(findex, blob.data(), blob.size(), *points);
                 }
-                // Skip deeper descendants
-            });
+            }
         }
+
+        return $cache().charge_points(id, findex, points, persisted)->points;
+    }
+
+    // read a window of the entry, returns the number of bytes read or -1 on failure
+    ptrdiff_t read(zipfs_handle & h, uint64_t offset, void * buffer, size_t length) {
+        if(h.stream && h.stream->compression != zip_compression_method::NONE) {
+            return read_blocks(h, offset, static_cast<uint8_t *>(buffer), length);
+        }
+
+        if(h.stream) {
+            return h.stream->read(offset, static_cast<uint8_t *>(buffer), length);
+        }
+
+        // a read covering a whole entry that is not cached is decompressed straight into the caller's buffer
+        if(offset == 0 && !$cache().contains(id, h.findex)) {
+            auto entry_size = archive.get_file_stat(h.findex).uncompressed_size; if(length >= entry_size) {
+                return archive.decompress_into(h.findex, 0, static_cast<uint8_t *>(buffer), entry_size);
+            }
+        }
+
+        auto s = read(h.findex, offset + length <= HEAD_SIZE ? static_cast<size_t>(offset + length) : SIZE_MAX); if(!s.data()) {
+            return -1;
+        }
+
+        if(offset >= s.size()) return 0;
+
+        auto n = (size_t)std::min<uint64_t>(s.size() - offset, length); memcpy(buffer, s.data() + offset, n);
+
+        return n;
+    }
+
+    // read a window of a streamed compressed entry through cached blocks, missing ones are filled from the handle's cursor
+    ptrdiff_t read_blocks(zipfs_handle & h, uint64_t offset, uint8_t * buffer, size_t length) {
+        uint64_t entry_size = h.stream->uncompressed_size; if(offset >= entry_size) {
+            return 0;
+        }
+
+        length = (size_t)std::min<uint64_t>(length, entry_size - offset);
+
+        for(size_t done = 0; done < length;) {
+            uint64_t pos = offset + done; uint32_t block = static_cast<uint32_t>(pos / BLOCK_SIZE); uint64_t start = uint64_t(block) * BLOCK_SIZE;
+
+            auto data = $cache().get_block(id, h.findex, block); if(!data) {
+                std::vector<uint8_t> fill((size_t)std::min<uint64_t>(BLOCK_SIZE, entry_size - start)); if(h.stream->read(start, fill.data(), fill.size()) != (ptrdiff_t)fill.size()) {
+                    return -1;
+                }
+
+                // the cursor used the access points and may have added some, they are charged before the block makes room
+                if(h.points) {
+                    $cache().charge_points(id, h.findex, h.points);
+                }
+
+                data = $cache().insert_block(id, h.findex, block, std::move(fill));
+            }
+
+            if(cache_trace) {
+                fprintf(cache_trace, "%u %d %u %zu\n", id, h.findex, block, data->size());
+            }
+
+            auto n = (size_t)std::min<uint64_t>(data->size() - (pos - start), length - done); memcpy(buffer + done, data->data() + (pos - start), n);
+
+            done += n;
+        }
+
+        return length;
+    }
+
+    template<typename F>
+    void each(string const & fname, F && f) {
+        size_t node = archive.find_node(fname); if(node == SIZE_MAX || !archive.node_is_directory(node)) {
+            return;
+        }
+
+        archive.for_each_child(node, [&](size_t child) {
+            size_t index = archive.node_entry(child);
+
+            stat_t st;
+            st.fpath = std::string(archive.node_name(child));
+
+            if(archive.node_is_directory(child)) {
+                st.size = 0;
+                st.mtime = index == SIZE_MAX ? 0 : archive.get_file_stat(index).mod_time;
+                st.type = zipfs_archive::DIR;
+            } else {
+                auto info = archive.get_file_stat(index);
+                st.size = info.uncompressed_size;
+                st.mtime = info.mod_time;
+                st.type = zipfs_archive::FILE;
+            }
+
+            f(st);
+        });
     }
 };
 
@@ -371,6 +547,10 @@ static zipfs_archive & $archive(fs::path const & fname) {
     archives[fname] = ar; return *ar;
 }
 
+static zipfs_handle * $handle(PDOKAN_FILE_INFO DokanFileInfo) {
+    return reinterpret_cast<zipfs_handle *>(DokanFileInfo->Context);
+}
+
 // fs callbacks
 static NTSTATUS DOKAN_CALLBACK zmCreateFile(LPCWSTR FileName, PDOKAN_IO_SECURITY_CONTEXT SecurityContext, ACCESS_MASK DesiredAccess, ULONG FileAttributes, ULONG ShareAccess, ULONG CreateDisposition, ULONG CreateOptions, PDOKAN_FILE_INFO DokanFileInfo) {
     archive_path ap(FileName); if(ap.is_root()) {
@@ -403,8 +583,6 @@ static NTSTATUS DOKAN_CALLBACK zmCreateFile(LPCWSTR FileName, PDOKAN_IO_SECURITY
         return DokanNtStatusFromWin32(ERROR_FILE_EXISTS);
     }
 
-    DokanFileInfo->Context = findex;
-
     bool is_dir = (ftype == 2); if(is_dir) {
         DokanFileInfo->IsDirectory = TRUE;
 
@@ -415,28 +593,29 @@ static NTSTATUS DOKAN_CALLBACK zmCreateFile(LPCWSTR FileName, PDOKAN_IO_SECURITY
 
     DokanFileInfo->IsDirectory = FALSE;
 
+    DokanFileInfo->Context = reinterpret_cast<ULONG64>(ar.open_handle(findex));
+
     return STATUS_SUCCESS;
 }
 
-static void DOKAN_CALLBACK zmCloseFile(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo) {}
+static void DOKAN_CALLBACK zmCloseFile(LPCWSTR FileName, PDOKAN_FILE_INFO DokanFileInfo) {
+    auto h = $handle(DokanFileInfo); if(h) {
+        $archive(archive_path(FileName).archive).close_handle(h); DokanFileInfo->Context = 0;
+    }
+}
 
 static NTSTATUS DOKAN_CALLBACK zmReadFile(LPCWSTR FileName, LPVOID Buffer, DWORD BufferLength, LPDWORD ReadLength, LONGLONG Offset, PDOKAN_FILE_INFO DokanFileInfo) {
-    int findex = DokanFileInfo->Context;
+    auto h = $handle(DokanFileInfo); if(!h || Offset < 0) {
+        *ReadLength = 0; return STATUS_UNSUCCESSFUL;
+    }
 
     auto & ar = $archive(archive_path(FileName).archive);
 
-    auto s = ar.read(findex);
-    if (s.empty()) {
-        *ReadLength = 0;
-        return STATUS_UNSUCCESSFUL;
+    auto n = ar.read(*h, Offset, Buffer, BufferLength); if(n < 0) {
+        *ReadLength = 0; return STATUS_UNSUCCESSFUL;
     }
 
-    auto size = s.size();
-    auto toread = std::min(size - Offset, (size_t)BufferLength);
-
-    memcpy(Buffer, s.data() + Offset, toread);
-
-    *ReadLength = toread;
+    *ReadLength = (DWORD)n;
 
     return STATUS_SUCCESS;
 }
@@ -477,7 +656,7 @@ static NTSTATUS DOKAN_CALLBACK zmGetFileInformation(LPCWSTR FileName, LPBY_HANDL
         HandleFileInformation->dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY; return STATUS_SUCCESS;
     }
 
-    int findex = DokanFileInfo->Context;
+    auto h = $handle(DokanFileInfo); int findex = h ? h->findex : -1;
 
     auto & ar = $archive(archive_path(FileName).archive);
 
@@ -556,14 +735,16 @@ static NTSTATUS DOKAN_CALLBACK zmFindFiles(LPCWSTR FileName, PFillFindData FillF
 
     archive_path ap(FileName); auto dname = W2A(ap.path.generic_wstring().c_str());
 
-    auto & ar = $archive(ap.archive);
+    auto & ar = $archive(ap.archive); if(!ar) {
+        return DokanNtStatusFromWin32(ERROR_FILE_NOT_FOUND);
+    }
 
     ar.each(dname, [&](auto const & stat) {
         WIN32_FIND_DATAW find_data {0}; if(stat.is_dir()) {
             find_data.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
         }
         else {
-            auto ftime = time64_to_filetime(stat.mtime);
+            auto ftime = dos_time_to_filetime(stat.mtime);
 
             find_data.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
             find_data.nFileSizeLow = stat.size;
@@ -598,6 +779,45 @@ int main(int argc, char ** argv) {
         ok(format("check existance of {}", options.root_directory.value())) =
             fs::exists(root_directory);
 
+        if(options.index_directory) {
+            index_directory = A2W(options.index_directory.value().c_str()); error_code ec;
+
+            ok(format("prepare index directory {}", options.index_directory.value())) =
+                (fs::create_directories(index_directory, ec), fs::is_directory(index_directory));
+        }
+
+        if(options.decoder) {
+            auto decoder = options.decoder.value() == "libdeflate" ? zip_decoder::LIBDEFLATE : zip_decoder::ZLIB;
+
+            ok(format("select decoder {}", options.decoder.value())) =
+                ((options.decoder.value() == "zlib" || options.decoder.value() == "libdeflate") && zip_inflate::available(decoder));
+
+            zip_inflate::decoder() = decoder;
+        }
+
+        cache_budget = options.cache_size.value() << 20; cache_quota = options.cache_quota.value() << 20;
+
+        if(options.cache_policy) {
+            auto & p = options.cache_policy.value();
+
+            ok(format("select cache policy {}", p)) = (p == "lru" || p == "2q" || p == "tinylfu");
+
+            cache_eviction = p == "lru" ? cache_policy::LRU : p == "2q" ? cache_policy::TWO_Q : cache_policy::TINY_LFU;
+        }
+
+        if(options.cache_trace) {
+            ok(format("open cache trace {}", options.cache_trace.value())) =
+                ((cache_trace = fopen(options.cache_trace.value().c_str(), "w")) != nullptr);
+        }
+
+        if(options.verify) {
+            auto & v = options.verify.value();
+
+            ok(format("select verification {}", v)) = (v == "full" || v == "lazy" || v == "none");
+
+            zip_crc32::verify() = v == "none" ? zip_verify::NONE : v == "lazy" ? zip_verify::LAZY : zip_verify::FULL;
+        }
+
         SetConsoleCtrlHandler([](DWORD type) {
             switch(type) {
                 case CTRL_C_EVENT: